@@ -40,7 +40,7 @@ static void usage(void)
 "where	OBJECT := { link | fdb | mdb | vlan | monitor }\n"
 "	OPTIONS := { -V[ersion] | -s[tatistics] | -d[etails] |\n"
 "		     -o[neline] | -t[imestamp] | -n[etns] name |\n"
-"		     -c[ompressvlans] -color -p[retty] -j[son] }\n");
+"		     -c[ompressvlans] -color -p[retty] -j[son] | -json-lines | -cbor }\n");
 	exit(-1);
 }
 
@@ -180,6 +180,12 @@ main(int argc, char **argv)
 			++force;
 		} else if (matches(opt, "-json") == 0) {
 			++json;
+		} else if (strcmp(opt, "-json-lines") == 0) {
+			++json;
+			++json_lines;
+		} else if (strcmp(opt, "-cbor") == 0) {
+			++json;
+			++cbor;
 		} else if (matches(opt, "-pretty") == 0) {
 			++pretty;
 		} else if (matches(opt, "-batch") == 0) {
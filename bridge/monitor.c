@@ -39,32 +39,37 @@ static int accept_msg(struct rtnl_ctrl_data *ctrl,
 		      struct nlmsghdr *n, void *arg)
 {
 	FILE *fp = arg;
+	int ret;
 
-	if (timestamp)
+	if (timestamp && !is_json_context())
 		print_timestamp(fp);
 
 	switch (n->nlmsg_type) {
 	case RTM_NEWLINK:
 	case RTM_DELLINK:
-		if (prefix_banner)
+		if (prefix_banner && !is_json_context())
 			fprintf(fp, "[LINK]");
 
 		return print_linkinfo(n, arg);
 
 	case RTM_NEWNEIGH:
 	case RTM_DELNEIGH:
-		if (prefix_banner)
+		if (prefix_banner && !is_json_context())
 			fprintf(fp, "[NEIGH]");
 		return print_fdb(n, arg);
 
 	case RTM_NEWMDB:
 	case RTM_DELMDB:
-		if (prefix_banner)
+		if (prefix_banner && !is_json_context())
 			fprintf(fp, "[MDB]");
-		return print_mdb(n, arg);
+		open_json_object(NULL);
+		ret = print_mdb(n, arg);
+		close_json_object();
+		return ret;
 
 	case NLMSG_TSTAMP:
-		print_nlmsg_timestamp(fp, n);
+		if (!is_json_context())
+			print_nlmsg_timestamp(fp, n);
 		return 0;
 
 	default:
@@ -127,7 +132,9 @@ int do_monitor(int argc, char **argv)
 			perror("Cannot fopen");
 			exit(-1);
 		}
+		new_json_obj(json);
 		err = rtnl_from_file(fp, accept_msg, stdout);
+		delete_json_obj();
 		fclose(fp);
 		return err;
 	}
@@ -136,6 +143,9 @@ int do_monitor(int argc, char **argv)
 		exit(1);
 	ll_init_map(&rth);
 
+	new_json_obj(json);
+	rth.idle = fflush_fp;
+
 	if (rtnl_listen(&rth, accept_msg, stdout) < 0)
 		exit(2);
 
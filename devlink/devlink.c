@@ -259,6 +259,7 @@ struct dl {
 	json_writer_t *jw;
 	bool json_output;
 	bool pretty_output;
+	bool cbor_output;
 	bool verbose;
 	struct {
 		bool present;
@@ -6282,7 +6283,7 @@ static void help(void)
 	pr_err("Usage: devlink [ OPTIONS ] OBJECT { COMMAND | help }\n"
 	       "       devlink [ -f[orce] ] -b[atch] filename\n"
 	       "where  OBJECT := { dev | port | sb | monitor | dpipe | resource | region | health }\n"
-	       "       OPTIONS := { -V[ersion] | -n[o-nice-names] | -j[son] | -p[retty] | -v[erbose] }\n");
+	       "       OPTIONS := { -V[ersion] | -n[o-nice-names] | -j[son] | --cbor | -p[retty] | -v[erbose] }\n");
 }
 
 static int dl_cmd(struct dl *dl, int argc, char **argv)
@@ -6344,6 +6345,7 @@ static int dl_init(struct dl *dl)
 			goto err_json_new;
 		}
 		jsonw_pretty(dl->jw, dl->pretty_output);
+		jsonw_cbor(dl->jw, dl->cbor_output);
 	}
 	return 0;
 
@@ -6425,6 +6427,7 @@ int main(int argc, char **argv)
 		{ "no-nice-names",	no_argument,		NULL, 'n' },
 		{ "json",		no_argument,		NULL, 'j' },
 		{ "pretty",		no_argument,		NULL, 'p' },
+		{ "cbor",		no_argument,		NULL, 'C' },
 		{ "verbose",		no_argument,		NULL, 'v' },
 		{ NULL, 0, NULL, 0 }
 	};
@@ -6464,6 +6467,10 @@ int main(int argc, char **argv)
 		case 'p':
 			dl->pretty_output = true;
 			break;
+		case 'C':
+			dl->json_output = true;
+			dl->cbor_output = true;
+			break;
 		case 'v':
 			dl->verbose = true;
 			break;
@@ -35,6 +35,7 @@ void delete_json_obj(void);
 bool is_json_context(void);
 
 void fflush_fp(void);
+void tag_json_obj(jsonw_tag_fn *fn, void *arg);
 
 void open_json_object(const char *str);
 void close_json_object(void);
@@ -25,6 +25,29 @@ void jsonw_destroy(json_writer_t **self_p);
 /* Cause output to have pretty whitespace */
 void jsonw_pretty(json_writer_t *self, bool on);
 
+/* Write each top-level value compactly on a line of its own (NDJSON),
+ * leave out empty ones and only pass output on when the buffer fills
+ * or on jsonw_flush()
+ */
+void jsonw_lines(json_writer_t *self, bool on);
+
+/* Emit compact binary CBOR (RFC 8949) instead of JSON text; objects and
+ * arrays use indefinite lengths, integers keep all 64 bits and doubles
+ * are stored as such.  Together with jsonw_lines() this gives a CBOR
+ * sequence (RFC 8742).
+ */
+void jsonw_cbor(json_writer_t *self, bool on);
+
+/* Pass buffered output on and flush the stream */
+void jsonw_flush(json_writer_t *self);
+
+/* Call fn(arg) once, just before the next object that is not empty gets
+ * closed one level below the current one (the next record, at the top
+ * level or in a top-level array), so that it can add fields of its own
+ */
+typedef void (jsonw_tag_fn)(void *arg);
+void jsonw_tag(json_writer_t *self, jsonw_tag_fn *fn, void *arg);
+
 /* Add property name */
 void jsonw_name(json_writer_t *self, const char *name);
 
@@ -11,8 +11,18 @@
 #include <linux/if_addr.h>
 #include <linux/neighbour.h>
 #include <linux/netconf.h>
+#include <linux/nexthop.h>
 #include <arpa/inet.h>
 
+/* Receive side accounting, reset at the start of every dump */
+struct rtnl_dump_stats {
+	__u64			recv_calls;
+	__u64			recv_bytes;
+	__u64			recv_msgs;
+};
+
+struct rtnl_pipeline;
+
 struct rtnl_handle {
 	int			fd;
 	struct sockaddr_nl	local;
@@ -24,7 +34,21 @@ struct rtnl_handle {
 #define RTNL_HANDLE_F_LISTEN_ALL_NSID		0x01
 #define RTNL_HANDLE_F_SUPPRESS_NLERR		0x02
 #define RTNL_HANDLE_F_STRICT_CHK		0x04
+#define RTNL_HANDLE_F_DUMP_STATS		0x08
+#define RTNL_HANDLE_F_PIPELINE			0x10
 	int			flags;
+	/* receive arena, reused across reads and grown to fit; shared by
+	 * all reads on the handle, so an rtnl_talk() on it from a dump
+	 * filter overwrites the dump being walked
+	 */
+	char		       *rbuf;
+	size_t			rbuf_len;
+	struct rtnl_dump_stats	dump_stats;
+	struct rtnl_pipeline   *pipe;
+	/* run before waiting on a socket that has nothing queued */
+	void		      (*idle)(void);
+	/* sees each batch of dump replies before they are filtered */
+	void		      (*prefetch)(const struct nlmsghdr *n);
 };
 
 struct nlmsg_list {
@@ -32,9 +56,12 @@ struct nlmsg_list {
 	struct nlmsghdr   h;
 };
 
+struct nlmsg_chunk;
+
 struct nlmsg_chain {
 	struct nlmsg_list *head;
 	struct nlmsg_list *tail;
+	struct nlmsg_chunk *chunks;	/* storage of the messages */
 };
 
 extern int rcvbuf;
@@ -47,6 +74,7 @@ int rtnl_open_byproto(struct rtnl_handle *rth, unsigned int subscriptions,
 	__attribute__((warn_unused_result));
 
 void rtnl_close(struct rtnl_handle *rth);
+void rtnl_dump_stats_print(const struct rtnl_handle *rth, FILE *fp);
 void rtnl_set_strict_dump(struct rtnl_handle *rth);
 
 typedef int (*req_filter_fn_t)(struct nlmsghdr *nlh, int reqlen);
@@ -59,6 +87,9 @@ int rtnl_addrlbldump_req(struct rtnl_handle *rth, int family)
 int rtnl_routedump_req(struct rtnl_handle *rth, int family,
 		       req_filter_fn_t filter_fn)
 	__attribute__((warn_unused_result));
+int rtnl_nexthopdump_req(struct rtnl_handle *rth, int family,
+			 req_filter_fn_t filter_fn)
+	__attribute__((warn_unused_result));
 int rtnl_ruledump_req(struct rtnl_handle *rth, int family)
 	__attribute__((warn_unused_result));
 int rtnl_neighdump_req(struct rtnl_handle *rth, int family,
@@ -124,6 +155,24 @@ int rtnl_talk_iov(struct rtnl_handle *rtnl, struct iovec *iovec, size_t iovlen,
 int rtnl_talk_suppress_rtnl_errmsg(struct rtnl_handle *rtnl, struct nlmsghdr *n,
 				   struct nlmsghdr **answer)
 	__attribute__((warn_unused_result));
+
+/* Called once per acknowledged pipelined request, error is 0 or -errno.
+ * Replies to a request are passed on with error 0 ahead of its ACK.
+ */
+typedef int (*rtnl_ack_fn_t)(int tag, int error, const struct nlmsghdr *n,
+			     void *arg);
+int rtnl_talk_iov_ack(struct rtnl_handle *rtnl, struct iovec *iovec,
+		      size_t iovlen, rtnl_ack_fn_t fn, void *arg)
+	__attribute__((warn_unused_result));
+
+int rtnl_pipeline_init(struct rtnl_handle *rth, unsigned int window,
+		       rtnl_ack_fn_t fn, void *arg)
+	__attribute__((warn_unused_result));
+void rtnl_pipeline_begin(struct rtnl_handle *rth, int tag);
+void rtnl_pipeline_end(struct rtnl_handle *rth);
+int rtnl_pipeline_drain(struct rtnl_handle *rth);
+int rtnl_pipeline_destroy(struct rtnl_handle *rth);
+
 int rtnl_send(struct rtnl_handle *rth, const void *buf, int)
 	__attribute__((warn_unused_result));
 int rtnl_send_check(struct rtnl_handle *rth, const void *buf, int)
@@ -219,6 +268,7 @@ static inline const char *rta_getattr_str(const struct rtattr *rta)
 }
 
 int rtnl_listen_all_nsid(struct rtnl_handle *);
+int rtnl_add_nl_group(struct rtnl_handle *rth, unsigned int group);
 int rtnl_listen(struct rtnl_handle *, rtnl_listen_filter_t handler,
 		void *jarg);
 int rtnl_from_file(FILE *, rtnl_listen_filter_t handler,
@@ -113,6 +113,9 @@ static inline int list_empty(const struct list_head *head)
 	return head->next == head;
 }
 
+#define hlist_entry(ptr, type, member) \
+	container_of(ptr, type, member)
+
 #define hlist_for_each(pos, head) \
 	for (pos = (head)->first; pos ; pos = pos->next)
 
@@ -5,6 +5,9 @@
 int ll_remember_index(struct nlmsghdr *n, void *arg);
 
 void ll_init_map(struct rtnl_handle *rth);
+void ll_flush_map(void);
+int ll_watch_links(struct rtnl_handle *rth);
+void ll_watch_stop(void);
 unsigned ll_name_to_index(const char *name);
 const char *ll_index_to_name(unsigned idx);
 int ll_index_to_type(unsigned idx);
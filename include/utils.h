@@ -29,6 +29,8 @@ extern int oneline;
 extern int brief;
 extern int json;
 extern int pretty;
+extern int json_lines;
+extern int cbor;
 extern int timestamp;
 extern int timestamp_short;
 extern const char * _SL_;
@@ -179,6 +181,8 @@ const char *format_host_r(int af, int len, const void *addr,
 		      buf, buflen)
 
 const char *format_host(int af, int lne, const void *addr);
+void resolve_prefetch(int af, int len, const void *addr);
+void resolve_prefetch_nlmsg(const struct nlmsghdr *n);
 #define format_host_rta(af, rta) \
 	format_host(af, RTA_PAYLOAD(rta), RTA_DATA(rta))
 const char *rt_addr_n2a_r(int af, int len, const void *addr,
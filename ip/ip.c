@@ -37,6 +37,9 @@ int force;
 int max_flush_loops = 10;
 int batch_mode;
 bool do_all;
+int netns_jobs;
+static int nl_stats;
+static int link_watch;
 
 struct rtnl_handle rth = { .fd = -1 };
 
@@ -50,14 +53,16 @@ static void usage(void)
 "where  OBJECT := { link | address | addrlabel | route | rule | neigh | ntable |\n"
 "                   tunnel | tuntap | maddress | mroute | mrule | monitor | xfrm |\n"
 "                   netns | l2tp | fou | macsec | tcp_metrics | token | netconf | ila |\n"
-"                   vrf | sr }\n"
+"                   vrf | sr | nexthop }\n"
 "       OPTIONS := { -V[ersion] | -s[tatistics] | -d[etails] | -r[esolve] |\n"
-"                    -h[uman-readable] | -iec | -j[son] | -p[retty] |\n"
+"                    -h[uman-readable] | -iec | -j[son] | -json-lines | -cbor |\n"
+"                    -p[retty] |\n"
 "                    -f[amily] { inet | inet6 | mpls | bridge | link } |\n"
 "                    -4 | -6 | -I | -D | -M | -B | -0 |\n"
 "                    -l[oops] { maximum-addr-flush-attempts } | -br[ief] |\n"
 "                    -o[neline] | -t[imestamp] | -ts[hort] | -b[atch] [filename] |\n"
-"                    -rc[vbuf] [size] | -n[etns] name | -a[ll] | -c[olor]}\n");
+"                    -rc[vbuf] [size] | -n[etns] name | -a[ll] | -jobs N |\n"
+"                    -c[olor] | -nls[tats] | -li[nkwatch] }\n");
 	exit(-1);
 }
 
@@ -101,6 +106,7 @@ static const struct cmd {
 	{ "vrf",	do_ipvrf},
 	{ "sr",		do_seg6 },
 	{ "ip6tlv",	do_ip6tlv },
+	{ "nexthop",	do_ipnh },
 	{ "help",	do_help },
 	{ 0 }
 };
@@ -118,6 +124,192 @@ static int do_cmd(const char *argv0, int argc, char **argv)
 	return EXIT_FAILURE;
 }
 
+/* ip -all OBJECT show ...: run the command in every named network
+ * namespace, without leaving this process.  The namespaces take turns on
+ * a socket of their own, opened just before and closed right after; each
+ * record shown is marked with the namespace it came from.
+ */
+struct netns_names {
+	char			**names;
+	int			count;
+};
+
+struct netns_cmd {
+	const char		*argv0;
+	int			argc;
+	char			**argv;
+	const char		*name;
+	const struct rtnl_handle *home;
+};
+
+static int netns_name_add(char *nsname, void *arg)
+{
+	struct netns_names *all = arg;
+	char **names;
+
+	names = realloc(all->names, (all->count + 1) * sizeof(*names));
+	if (!names) {
+		perror("realloc");
+		return -1;
+	}
+	all->names = names;
+	names[all->count++] = strdup(nsname);
+	return 0;
+}
+
+static void netns_tag(void *arg)
+{
+	print_string(PRINT_JSON, "netns", NULL, arg);
+	/* and again for the next record */
+	tag_json_obj(netns_tag, arg);
+}
+
+static int netns_cmd_run(void *arg)
+{
+	struct netns_cmd *cmd = arg;
+	int ret;
+
+	if (rtnl_open(&rth, 0) < 0)
+		return -1;
+	rtnl_set_strict_dump(&rth);
+	rth.flags |= cmd->home->flags & RTNL_HANDLE_F_DUMP_STATS;
+	rth.prefetch = cmd->home->prefetch;
+
+	/* watch the links of this namespace, not those of the home one */
+	if (link_watch && ll_watch_links(&rth) < 0) {
+		rtnl_close(&rth);
+		return -1;
+	}
+
+	if (is_json_context())
+		tag_json_obj(netns_tag, (void *)cmd->name);
+	else
+		printf("\nnetns: %s\n", cmd->name);
+
+	ret = do_cmd(cmd->argv0, cmd->argc, cmd->argv);
+
+	tag_json_obj(NULL, NULL);
+	ll_watch_stop();
+	rtnl_close(&rth);
+	return ret;
+}
+
+static int do_cmd_all_netns(const char *argv0, int argc, char **argv)
+{
+	struct rtnl_handle home = rth;
+	struct netns_cmd cmd = { argv0, argc, argv, NULL, &home };
+	struct netns_names all = {};
+	int i, ret = 0;
+
+	if (netns_foreach(netns_name_add, &all) < 0)
+		return 0;
+
+	ll_watch_stop();
+	new_json_obj(json);
+	for (i = 0; i < all.count; i++) {
+		/* interface indexes mean something else in each namespace */
+		ll_flush_map();
+		cmd.name = all.names[i];
+		if (netns_run(all.names[i], netns_cmd_run, &cmd))
+			ret = EXIT_FAILURE;
+		free(all.names[i]);
+	}
+	delete_json_obj();
+
+	ll_flush_map();
+	rth = home;
+	if (link_watch && ll_watch_links(&rth) < 0)
+		ret = EXIT_FAILURE;
+	free(all.names);
+	return ret;
+}
+
+/* Only commands which show something go to every namespace; a monitor
+ * would never get past the first one.
+ */
+static bool cmd_all_supported(const struct cmd *c, int argc, char **argv)
+{
+	if (c->func == do_ipmonitor)
+		return false;
+
+	return argc < 1 ||
+	       matches(*argv, "show") == 0 ||
+	       matches(*argv, "list") == 0 ||
+	       matches(*argv, "lst") == 0 ||
+	       matches(*argv, "get") == 0;
+}
+
+static int do_cmd_all(const char *argv0, int argc, char **argv)
+{
+	const struct cmd *c;
+
+	for (c = cmds; c->cmd; ++c) {
+		if (matches(argv0, c->cmd) == 0)
+			break;
+	}
+
+	/* ip -all netns has a meaning of its own */
+	if (!do_all || !c->cmd || c->func == do_netns)
+		return do_cmd(argv0, argc, argv);
+
+	if (!cmd_all_supported(c, argc - 1, argv + 1)) {
+		fprintf(stderr,
+			"Option \"-all\" only applies to show, list and get of \"%s\".\n",
+			argv0);
+		return EXIT_FAILURE;
+	}
+
+	return do_cmd_all_netns(argv0, argc, argv);
+}
+
+#define IP_MAX_SUBC	10
+static bool batch_pipelined(int argc, char *argv[])
+{
+	struct {
+		char *c;
+		char *subc[IP_MAX_SUBC];
+	} table[] = {
+		{ "address", { "add", "change", "replace", "delete", NULL } },
+		{ "route", { "add", "change", "replace", "delete", "append",
+			     "prepend", NULL } },
+		{ "neighbour", { "add", "change", "replace", "delete", NULL } },
+		{ "neighbor", { "add", "change", "replace", "delete", NULL } },
+		{ "nexthop", { "add", "replace", "delete", NULL } },
+		{ NULL },
+	}, *iter;
+	char *s;
+	int i;
+
+	if (argc < 2)
+		return false;
+
+	for (iter = table; iter->c; iter++) {
+		if (matches(argv[0], iter->c))
+			continue;
+		for (i = 0; i < IP_MAX_SUBC; i++) {
+			s = iter->subc[i];
+			if (s && matches(argv[1], s) == 0)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static bool batch_failed;
+
+static int batch_ack(int lineno, int error, const struct nlmsghdr *n,
+		     void *arg)
+{
+	const char *name = arg;
+
+	if (error) {
+		fprintf(stderr, "Command failed %s:%d\n", name, lineno);
+		batch_failed = true;
+	}
+	return 0;
+}
+
 static int batch(const char *name)
 {
 	char *line = NULL;
@@ -141,10 +333,27 @@ static int batch(const char *name)
 		return EXIT_FAILURE;
 	}
 
+	if (nl_stats)
+		rth.flags |= RTNL_HANDLE_F_DUMP_STATS;
+	if (resolve_hosts)
+		rth.prefetch = resolve_prefetch_nlmsg;
+
+	if (link_watch && ll_watch_links(&rth) < 0) {
+		rtnl_close(&rth);
+		return EXIT_FAILURE;
+	}
+
+	if (rtnl_pipeline_init(&rth, IP_PIPELINE_WINDOW, batch_ack,
+			       (void *)name) < 0) {
+		rtnl_close(&rth);
+		return EXIT_FAILURE;
+	}
+
 	cmdlineno = 0;
 	while (getcmdline(&line, &len, stdin) != -1) {
 		char *largv[100];
 		int largc;
+		int err;
 
 		preferred_family = orig_family;
 
@@ -152,17 +361,38 @@ static int batch(const char *name)
 		if (largc == 0)
 			continue;	/* blank line */
 
-		if (do_cmd(largv[0], largc, largv)) {
+		/*
+		 * Plain modifications are sent without waiting for the
+		 * kernel, their ACKs are collected by batch_ack().  Anything
+		 * else waits for the requests in flight first, so that its
+		 * output and errors appear in input order.
+		 */
+		if (batch_pipelined(largc, largv)) {
+			rtnl_pipeline_begin(&rth, cmdlineno);
+			err = do_cmd(largv[0], largc, largv);
+			rtnl_pipeline_end(&rth);
+		} else {
+			rtnl_pipeline_drain(&rth);
+			if (batch_failed && !force)
+				break;
+			err = do_cmd(largv[0], largc, largv);
+		}
+
+		if (err) {
 			fprintf(stderr, "Command failed %s:%d\n",
 				name, cmdlineno);
-			ret = EXIT_FAILURE;
-			if (!force)
-				break;
+			batch_failed = true;
 		}
+		if (batch_failed && !force)
+			break;
 	}
 	if (line)
 		free(line);
 
+	rtnl_pipeline_drain(&rth);
+	if (batch_failed)
+		ret = EXIT_FAILURE;
+
 	rtnl_close(&rth);
 	return ret;
 }
@@ -266,6 +496,12 @@ int main(int argc, char **argv)
 			++brief;
 		} else if (matches(opt, "-json") == 0) {
 			++json;
+		} else if (strcmp(opt, "-json-lines") == 0) {
+			++json;
+			++json_lines;
+		} else if (strcmp(opt, "-cbor") == 0) {
+			++json;
+			++cbor;
 		} else if (matches(opt, "-pretty") == 0) {
 			++pretty;
 		} else if (matches(opt, "-rcvbuf") == 0) {
@@ -290,6 +526,15 @@ int main(int argc, char **argv)
 				exit(-1);
 		} else if (matches(opt, "-all") == 0) {
 			do_all = true;
+		} else if (matches(opt, "-jobs") == 0) {
+			NEXT_ARG();
+			if (get_integer(&netns_jobs, argv[1], 0) ||
+			    netns_jobs < 1)
+				invarg("invalid number of jobs", argv[1]);
+		} else if (matches(opt, "-nlstats") == 0) {
+			++nl_stats;
+		} else if (matches(opt, "-linkwatch") == 0) {
+			++link_watch;
 		} else {
 			fprintf(stderr,
 				"Option \"%s\" is unknown, try \"ip -help\".\n",
@@ -311,11 +556,19 @@ int main(int argc, char **argv)
 
 	rtnl_set_strict_dump(&rth);
 
+	if (nl_stats)
+		rth.flags |= RTNL_HANDLE_F_DUMP_STATS;
+	if (resolve_hosts)
+		rth.prefetch = resolve_prefetch_nlmsg;
+
+	if (link_watch && ll_watch_links(&rth) < 0)
+		exit(1);
+
 	if (strlen(basename) > 2)
-		return do_cmd(basename+2, argc, argv);
+		return do_cmd_all(basename+2, argc, argv);
 
 	if (argc > 1)
-		return do_cmd(argv[1], argc-1, argv+1);
+		return do_cmd_all(argv[1], argc-1, argv+1);
 
 	rtnl_close(&rth);
 	usage();
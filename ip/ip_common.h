@@ -42,6 +42,7 @@ void ipneigh_reset_filter(int ifindex);
 void ipnetconf_reset_filter(int ifindex);
 
 int print_route(struct nlmsghdr *n, void *arg);
+int print_nexthop(struct nlmsghdr *n, void *arg);
 int print_mroute(struct nlmsghdr *n, void *arg);
 int print_prefix(struct nlmsghdr *n, void *arg);
 int print_rule(struct nlmsghdr *n, void *arg);
@@ -56,6 +57,7 @@ int set_netnsid_from_name(const char *name, int nsid);
 int do_ipaddr(int argc, char **argv);
 int do_ipaddrlabel(int argc, char **argv);
 int do_iproute(int argc, char **argv);
+int do_ipnh(int argc, char **argv);
 int do_iprule(int argc, char **argv);
 int do_ipneigh(int argc, char **argv);
 int do_ipntable(int argc, char **argv);
@@ -82,12 +84,21 @@ void vrf_reset(void);
 int netns_identify_pid(const char *pidstr, char *name, int len);
 int do_seg6(int argc, char **argv);
 
+void print_rt_flags(FILE *fp, unsigned int flags);
+void print_rta_if(FILE *fp, const struct rtattr *rta, const char *prefix);
+void print_rta_gateway(FILE *fp, unsigned char family,
+		       const struct rtattr *rta);
+
 int iplink_get(char *name, __u32 filt_mask);
 int iplink_ifla_xstats(int argc, char **argv);
 
 int ip_link_list(req_filter_fn_t filter_fn, struct nlmsg_chain *linfo);
+int store_nlmsg(struct nlmsghdr *n, void *arg);
 void free_nlmsg_chain(struct nlmsg_chain *info);
 
+/* Number of requests kept in flight by pipelined commands */
+#define IP_PIPELINE_WINDOW	128
+
 static inline int rtm_get_table(struct rtmsg *r, struct rtattr **tb)
 {
 	__u32 table = r->rtm_table;
@@ -98,6 +109,7 @@ static inline int rtm_get_table(struct rtmsg *r, struct rtattr **tb)
 }
 
 extern struct rtnl_handle rth;
+extern int netns_jobs;
 
 struct iplink_req {
 	struct nlmsghdr		n;
@@ -135,7 +147,8 @@ int bond_parse_xstats(struct link_util *lu, int argc, char **argv);
 int bond_print_xstats(struct nlmsghdr *n, void *arg);
 
 /* iproute_lwtunnel.c */
-int lwt_parse_encap(struct rtattr *rta, size_t len, int *argcp, char ***argvp);
+int lwt_parse_encap(struct rtattr *rta, size_t len, int *argcp, char ***argvp,
+		    __u16 encap_attr, __u16 encap_type_attr);
 void lwt_print_encap(FILE *fp, struct rtattr *encap_type, struct rtattr *encap);
 
 /* iplink_xdp.c */
@@ -35,6 +35,7 @@
 #include "ll_map.h"
 #include "ip_common.h"
 #include "color.h"
+#include "list.h"
 
 enum {
 	IPADD_LIST,
@@ -45,6 +46,23 @@ enum {
 static struct link_filter filter;
 static int do_link;
 
+/* Addresses of one link, pointing into the address chain */
+struct ifa_link {
+	struct hlist_node	hash;
+	int			ifindex;
+	unsigned int		count;
+	unsigned int		max;
+	struct nlmsg_list	**addrs;
+};
+
+/* Address dump, indexed by ifindex */
+struct ifa_index {
+	struct nlmsg_chain	chain;
+	struct hlist_head	*hash;
+	unsigned int		size;
+	unsigned int		links;
+};
+
 static void usage(void) __attribute__((noreturn));
 
 static void usage(void)
@@ -1454,21 +1472,16 @@ brief_exit:
 }
 
 static int print_selected_addrinfo(struct ifinfomsg *ifi,
-				   struct nlmsg_list *ainfo, FILE *fp)
+				   struct ifa_link *al, FILE *fp)
 {
+	unsigned int i;
+
 	open_json_array(PRINT_JSON, "addr_info");
-	for ( ; ainfo ;  ainfo = ainfo->next) {
-		struct nlmsghdr *n = &ainfo->h;
+	for (i = 0; al && i < al->count; i++) {
+		struct nlmsghdr *n = &al->addrs[i]->h;
 		struct ifaddrmsg *ifa = NLMSG_DATA(n);
 
-		if (n->nlmsg_type != RTM_NEWADDR)
-			continue;
-
-		if (n->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
-			return -1;
-
-		if (ifa->ifa_index != ifi->ifi_index ||
-		    (filter.family && filter.family != ifa->ifa_family))
+		if (filter.family && filter.family != ifa->ifa_family)
 			continue;
 
 		if (filter.up && !(ifi->ifi_flags&IFF_UP))
@@ -1487,13 +1500,51 @@ static int print_selected_addrinfo(struct ifinfomsg *ifi,
 	return 0;
 }
 
+/* Messages of a nlmsg_chain are packed into chunks, which are only
+ * released all together by free_nlmsg_chain().
+ */
+#define NLMSG_CHUNK_SIZE	(128 * 1024)
+
+struct nlmsg_chunk {
+	struct nlmsg_chunk	*next;
+	size_t			size;
+	size_t			used;
+	char			data[];
+};
 
-static int store_nlmsg(struct nlmsghdr *n, void *arg)
+static struct nlmsg_list *nlmsg_chain_alloc(struct nlmsg_chain *lchain,
+					    size_t len)
+{
+	struct nlmsg_chunk *c = lchain->chunks;
+	struct nlmsg_list *h;
+
+	len = (len + __alignof__(*h) - 1) & ~(__alignof__(*h) - 1);
+
+	if (!c || c->size - c->used < len) {
+		size_t size = MAX(len, NLMSG_CHUNK_SIZE);
+
+		c = malloc(sizeof(*c) + size);
+		if (c == NULL)
+			return NULL;
+
+		c->size = size;
+		c->used = 0;
+		c->next = lchain->chunks;
+		lchain->chunks = c;
+	}
+
+	h = (struct nlmsg_list *)(c->data + c->used);
+	c->used += len;
+	return h;
+}
+
+int store_nlmsg(struct nlmsghdr *n, void *arg)
 {
 	struct nlmsg_chain *lchain = (struct nlmsg_chain *)arg;
 	struct nlmsg_list *h;
 
-	h = malloc(n->nlmsg_len+sizeof(void *));
+	h = nlmsg_chain_alloc(lchain,
+			      offsetof(struct nlmsg_list, h) + n->nlmsg_len);
 	if (h == NULL)
 		return -1;
 
@@ -1510,6 +1561,116 @@ static int store_nlmsg(struct nlmsghdr *n, void *arg)
 	return 0;
 }
 
+static struct ifa_link *ifa_index_lookup(const struct ifa_index *idx,
+					 int ifindex)
+{
+	struct ifa_link *al;
+
+	if (!idx->size)
+		return NULL;
+
+	hlist_for_each_entry(al, &idx->hash[ifindex & (idx->size - 1)], hash)
+		if (al->ifindex == ifindex)
+			return al;
+
+	return NULL;
+}
+
+static int ifa_index_grow(struct ifa_index *idx)
+{
+	unsigned int size = idx->size ? idx->size * 2 : 256;
+	struct hlist_head *hash;
+	unsigned int i;
+
+	hash = calloc(size, sizeof(*hash));
+	if (!hash)
+		return -1;
+
+	for (i = 0; i < idx->size; i++) {
+		struct hlist_node *n, *tmp;
+
+		hlist_for_each_safe(n, tmp, &idx->hash[i]) {
+			struct ifa_link *al
+				= container_of(n, struct ifa_link, hash);
+
+			hlist_add_head(&al->hash,
+				       &hash[al->ifindex & (size - 1)]);
+		}
+	}
+
+	free(idx->hash);
+	idx->hash = hash;
+	idx->size = size;
+	return 0;
+}
+
+/* Store an address message and index it by its link, so that every link
+ * finds its addresses without walking the whole address chain.
+ */
+static int store_addr_nlmsg(struct nlmsghdr *n, void *arg)
+{
+	struct ifa_index *idx = arg;
+	struct ifaddrmsg *ifa = NLMSG_DATA(n);
+	struct ifa_link *al;
+
+	if (n->nlmsg_type != RTM_NEWADDR)
+		return 0;
+
+	if (n->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+		return -1;
+
+	if (store_nlmsg(n, &idx->chain) < 0)
+		return -1;
+
+	al = ifa_index_lookup(idx, ifa->ifa_index);
+	if (!al) {
+		if (idx->links >= idx->size && ifa_index_grow(idx) < 0)
+			return -1;
+
+		al = calloc(1, sizeof(*al));
+		if (!al)
+			return -1;
+
+		al->ifindex = ifa->ifa_index;
+		hlist_add_head(&al->hash,
+			       &idx->hash[al->ifindex & (idx->size - 1)]);
+		idx->links++;
+	}
+
+	if (al->count == al->max) {
+		unsigned int max = al->max ? al->max * 2 : 4;
+		struct nlmsg_list **addrs;
+
+		addrs = realloc(al->addrs, max * sizeof(*addrs));
+		if (!addrs)
+			return -1;
+		al->addrs = addrs;
+		al->max = max;
+	}
+	al->addrs[al->count++] = idx->chain.tail;
+
+	return 0;
+}
+
+static void free_ifa_index(struct ifa_index *idx)
+{
+	unsigned int i;
+
+	for (i = 0; i < idx->size; i++) {
+		struct hlist_node *n, *tmp;
+
+		hlist_for_each_safe(n, tmp, &idx->hash[i]) {
+			struct ifa_link *al
+				= container_of(n, struct ifa_link, hash);
+
+			free(al->addrs);
+			free(al);
+		}
+	}
+	free(idx->hash);
+	free_nlmsg_chain(&idx->chain);
+}
+
 static __u32 ipadd_dump_magic = 0x47361222;
 
 static int ipadd_save_prep(void)
@@ -1620,15 +1781,18 @@ static int ipaddr_restore(void)
 
 void free_nlmsg_chain(struct nlmsg_chain *info)
 {
-	struct nlmsg_list *l, *n;
+	struct nlmsg_chunk *c, *n;
 
-	for (l = info->head; l; l = n) {
-		n = l->next;
-		free(l);
+	for (c = info->chunks; c; c = n) {
+		n = c->next;
+		free(c);
 	}
+
+	info->head = info->tail = NULL;
+	info->chunks = NULL;
 }
 
-static void ipaddr_filter(struct nlmsg_chain *linfo, struct nlmsg_chain *ainfo)
+static void ipaddr_filter(struct nlmsg_chain *linfo, struct ifa_index *ainfo)
 {
 	struct nlmsg_list *l, **lp;
 
@@ -1637,16 +1801,16 @@ static void ipaddr_filter(struct nlmsg_chain *linfo, struct nlmsg_chain *ainfo)
 		int ok = 0;
 		int missing_net_address = 1;
 		struct ifinfomsg *ifi = NLMSG_DATA(&l->h);
-		struct nlmsg_list *a;
+		struct ifa_link *al;
+		unsigned int i;
 
-		for (a = ainfo->head; a; a = a->next) {
-			struct nlmsghdr *n = &a->h;
+		al = ifa_index_lookup(ainfo, ifi->ifi_index);
+		for (i = 0; al && i < al->count; i++) {
+			struct nlmsghdr *n = &al->addrs[i]->h;
 			struct ifaddrmsg *ifa = NLMSG_DATA(n);
 			struct rtattr *tb[IFA_MAX + 1];
 			unsigned int ifa_flags;
 
-			if (ifa->ifa_index != ifi->ifi_index)
-				continue;
 			missing_net_address = 0;
 			if (filter.family && filter.family != ifa->ifa_family)
 				continue;
@@ -1673,10 +1837,9 @@ static void ipaddr_filter(struct nlmsg_chain *linfo, struct nlmsg_chain *ainfo)
 		if (missing_net_address &&
 		    (filter.family == AF_UNSPEC || filter.family == AF_PACKET))
 			ok = 1;
-		if (!ok) {
+		if (!ok)
 			*lp = l->next;
-			free(l);
-		} else
+		else
 			lp = &l->next;
 	}
 }
@@ -1804,12 +1967,57 @@ static int ipaddr_link_get(int index, struct nlmsg_chain *linfo)
 	return 0;
 }
 
+struct ipaddr_file_arg {
+	__u16		type;
+	rtnl_filter_t	store;
+	void		*arg;
+};
+
+static int ipaddr_file_store(struct rtnl_ctrl_data *ctrl,
+			     struct nlmsghdr *n, void *arg)
+{
+	struct ipaddr_file_arg *a = arg;
+
+	if (n->nlmsg_type != a->type)
+		return 0;
+
+	return a->store(n, a->arg);
+}
+
+/* Testsuite hook: IPADDR_DUMP_FILE names a file of saved RTM_NEWLINK and
+ * RTM_NEWADDR messages which is used in place of the kernel dumps.
+ */
+static int ipaddr_dump_file(__u16 type, rtnl_filter_t store, void *arg)
+{
+	struct ipaddr_file_arg a = {
+		.type = type,
+		.store = store,
+		.arg = arg,
+	};
+	FILE *fp;
+	int err;
+
+	fp = fopen(getenv("IPADDR_DUMP_FILE"), "r");
+	if (!fp) {
+		perror("Cannot open dump file");
+		return 1;
+	}
+
+	err = rtnl_from_file(fp, ipaddr_file_store, &a);
+	fclose(fp);
+
+	return err < 0;
+}
+
 /* fills in linfo with link data and optionally ainfo with address info
  * caller can walk lists as desired and must call free_nlmsg_chain for
  * both when done
  */
 int ip_link_list(req_filter_fn_t filter_fn, struct nlmsg_chain *linfo)
 {
+	if (getenv("IPADDR_DUMP_FILE"))
+		return ipaddr_dump_file(RTM_NEWLINK, store_nlmsg, linfo);
+
 	if (rtnl_linkdump_req_filter_fn(&rth, preferred_family,
 					filter_fn) < 0) {
 		perror("Cannot send dump request");
@@ -1824,14 +2032,17 @@ int ip_link_list(req_filter_fn_t filter_fn, struct nlmsg_chain *linfo)
 	return 0;
 }
 
-static int ip_addr_list(struct nlmsg_chain *ainfo)
+static int ip_addr_list(struct ifa_index *ainfo)
 {
+	if (getenv("IPADDR_DUMP_FILE"))
+		return ipaddr_dump_file(RTM_NEWADDR, store_addr_nlmsg, ainfo);
+
 	if (rtnl_addrdump_req(&rth, filter.family, ipaddr_dump_filter) < 0) {
 		perror("Cannot send dump request");
 		return 1;
 	}
 
-	if (rtnl_dump_filter(&rth, store_nlmsg, ainfo) < 0) {
+	if (rtnl_dump_filter(&rth, store_addr_nlmsg, ainfo) < 0) {
 		fprintf(stderr, "Dump terminated\n");
 		return 1;
 	}
@@ -1842,7 +2053,7 @@ static int ip_addr_list(struct nlmsg_chain *ainfo)
 static int ipaddr_list_flush_or_save(int argc, char **argv, int action)
 {
 	struct nlmsg_chain linfo = { NULL, NULL};
-	struct nlmsg_chain _ainfo = { NULL, NULL}, *ainfo = &_ainfo;
+	struct ifa_index _ainfo = {}, *ainfo = &_ainfo;
 	struct nlmsg_list *l;
 	char *filter_dev = NULL;
 	int no_link = 0;
@@ -2012,7 +2223,9 @@ static int ipaddr_list_flush_or_save(int argc, char **argv, int action)
 		if (brief || !no_link)
 			res = print_linkinfo(n, stdout);
 		if (res >= 0 && filter.family != AF_PACKET)
-			print_selected_addrinfo(ifi, ainfo->head, stdout);
+			print_selected_addrinfo(ifi,
+				ifa_index_lookup(ainfo, ifi->ifi_index),
+				stdout);
 		if (res > 0 && !do_link && show_stats)
 			print_link_stats(stdout, n);
 		close_json_object();
@@ -2020,7 +2233,7 @@ static int ipaddr_list_flush_or_save(int argc, char **argv, int action)
 	fflush(stdout);
 
 out:
-	free_nlmsg_chain(ainfo);
+	free_ifa_index(ainfo);
 	free_nlmsg_chain(&linfo);
 	delete_json_obj();
 	return 0;
@@ -18,7 +18,10 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <errno.h>
+#include <ctype.h>
 #include <time.h>
+#include <sys/time.h>
 
 #include "utils.h"
 #include "ip_common.h"
@@ -31,13 +34,64 @@ static void usage(void)
 {
 	fprintf(stderr, "Usage: ip monitor [ all | LISTofOBJECTS ] [ FILE ] [ label ] [all-nsid] [dev DEVICE]\n");
 	fprintf(stderr, "LISTofOBJECTS := link | address | route | mroute | prefix |\n");
-	fprintf(stderr, "                 neigh | netconf | rule | nsid\n");
+	fprintf(stderr, "                 neigh | netconf | rule | nsid | nexthop\n");
 	fprintf(stderr, "FILE := file FILENAME\n");
 	exit(-1);
 }
 
+/* In JSON, the headers become fields of the object of the event */
+static struct {
+	char		type[16];
+	int		nsid;
+	struct timeval	tv;
+} event;
+
+static void print_event_tag(void *arg)
+{
+	if (timestamp) {
+		char ts[64];
+		size_t len;
+
+		len = strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S",
+			       localtime(&event.tv.tv_sec));
+		snprintf(ts + len, sizeof(ts) - len, ".%06ld",
+			 (long)event.tv.tv_usec);
+		print_string(PRINT_JSON, "timestamp", NULL, ts);
+	}
+
+	if (listen_all_nsid) {
+		if (event.nsid < 0)
+			print_string(PRINT_JSON, "nsid", NULL, "current");
+		else
+			print_int(PRINT_JSON, "nsid", NULL, event.nsid);
+	}
+
+	print_string(PRINT_JSON, "event", NULL, event.type);
+}
+
+static void tag_event(const char *label, struct rtnl_ctrl_data *ctrl)
+{
+	unsigned int i, j;
+
+	for (i = 0, j = 0; label[i] && j < sizeof(event.type) - 1; i++)
+		if (isalpha(label[i]))
+			event.type[j++] = tolower(label[i]);
+	event.type[j] = '\0';
+
+	event.nsid = ctrl ? ctrl->nsid : -1;
+	if (timestamp)
+		gettimeofday(&event.tv, NULL);
+
+	tag_json_obj(print_event_tag, NULL);
+}
+
 static void print_headers(FILE *fp, char *label, struct rtnl_ctrl_data *ctrl)
 {
+	if (is_json_context()) {
+		tag_event(label, ctrl);
+		return;
+	}
+
 	if (timestamp)
 		print_timestamp(fp);
 
@@ -265,6 +319,9 @@ static int accept_msg(struct rtnl_ctrl_data *ctrl,
 {
 	FILE *fp = (FILE *)arg;
 
+	/* drop the tag of an event that ended up filtered out */
+	tag_json_obj(NULL, NULL);
+
 	switch (n->nlmsg_type) {
 	case RTM_NEWROUTE:
 	case RTM_DELROUTE: {
@@ -291,17 +348,27 @@ static int accept_msg(struct rtnl_ctrl_data *ctrl,
 		}
 	}
 
+	case RTM_NEWNEXTHOP:
+	case RTM_DELNEXTHOP:
+		print_headers(fp, "[NEXTHOP]", ctrl);
+		print_nexthop(n, arg);
+		return 0;
+
 	case RTM_NEWLINK:
 	case RTM_DELLINK:
 		ll_remember_index(n, NULL);
 		print_headers(fp, "[LINK]", ctrl);
+		open_json_object(NULL);
 		print_linkinfo(n, arg);
+		close_json_object();
 		return 0;
 
 	case RTM_NEWADDR:
 	case RTM_DELADDR:
 		print_headers(fp, "[ADDR]", ctrl);
+		open_json_object(NULL);
 		print_addrinfo(n, arg);
+		close_json_object();
 		return 0;
 
 	case RTM_NEWADDRLABEL:
@@ -336,7 +403,8 @@ static int accept_msg(struct rtnl_ctrl_data *ctrl,
 		return 0;
 
 	case NLMSG_TSTAMP:
-		print_nlmsg_timestamp(fp, n);
+		if (!is_json_context())
+			print_nlmsg_timestamp(fp, n);
 		return 0;
 
 	case RTM_NEWNETCONF:
@@ -353,7 +421,9 @@ static int accept_msg(struct rtnl_ctrl_data *ctrl,
 
 	case RTM_NOTIFYROUTE:
 		print_headers(fp, "[NOTIFYROUTE]", ctrl);
+		open_json_object(NULL);
 		print_routenotify(n, arg);
+		close_json_object();
 		return 0;
 
 	case NLMSG_ERROR:
@@ -385,6 +455,8 @@ int do_ipmonitor(int argc, char **argv)
 	int lnetconf = 0;
 	int lrule = 0;
 	int lnsid = 0;
+	int lnexthop = 0;
+	int lnexthop_all = 0;
 	int ifindex = 0;
 	int lrtnotify = 0;
 
@@ -444,6 +516,9 @@ int do_ipmonitor(int argc, char **argv)
 		} else if (matches(*argv, "routenotify") == 0) {
 			lrtnotify = 1;
 			groups = 0;
+		} else if (matches(*argv, "nexthop") == 0) {
+			lnexthop = 1;
+			groups = 0;
 		} else if (strcmp(*argv, "all") == 0) {
 			prefix_banner = 1;
 		} else if (matches(*argv, "all-nsid") == 0) {
@@ -463,6 +538,10 @@ int do_ipmonitor(int argc, char **argv)
 		argc--;	argv++;
 	}
 
+	/* nothing selected, listen to everything the kernel has */
+	if (groups)
+		lnexthop = lnexthop_all = 1;
+
 	ipaddr_reset_filter(1, ifindex);
 	iproute_reset_filter(ifindex);
 	ipmroute_reset_filter(ifindex);
@@ -527,7 +606,9 @@ int do_ipmonitor(int argc, char **argv)
 			perror("Cannot fopen");
 			exit(-1);
 		}
+		new_json_obj(json);
 		err = rtnl_from_file(fp, accept_msg, stdout);
+		delete_json_obj();
 		fclose(fp);
 		return err;
 	}
@@ -536,11 +617,22 @@ int do_ipmonitor(int argc, char **argv)
 		exit(1);
 	if (listen_all_nsid && rtnl_listen_all_nsid(&rth) < 0)
 		exit(1);
+	if (lnexthop && rtnl_add_nl_group(&rth, RTNLGRP_NEXTHOP) < 0) {
+		if (!lnexthop_all) {
+			fprintf(stderr, "Failed to add nexthop group to list\n");
+			exit(1);
+		}
+		fprintf(stderr, "Warning: not monitoring nexthop objects: %s\n",
+			strerror(errno));
+	}
 
 	ll_init_map(&rth);
 	netns_nsid_socket_init();
 	netns_map_init();
 
+	new_json_obj(json);
+	rth.idle = fflush_fp;
+
 	if (rtnl_listen(&rth, accept_msg, stdout) < 0)
 		exit(2);
 
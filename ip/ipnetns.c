@@ -6,6 +6,7 @@
 #include <sys/inotify.h>
 #include <sys/mount.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
 #include <stdio.h>
 #include <string.h>
 #include <sched.h>
@@ -14,6 +15,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <poll.h>
 #include <linux/limits.h>
 
 #include <linux/net_namespace.h>
@@ -33,7 +35,7 @@ static int usage(void)
 	fprintf(stderr, "       ip [-all] netns delete [NAME]\n");
 	fprintf(stderr, "       ip netns identify [PID]\n");
 	fprintf(stderr, "       ip netns pids NAME\n");
-	fprintf(stderr, "       ip [-all] netns exec [NAME] cmd ...\n");
+	fprintf(stderr, "       ip [-all [-jobs N]] netns exec [NAME] cmd ...\n");
 	fprintf(stderr, "       ip netns monitor\n");
 	fprintf(stderr, "       ip netns list-id\n");
 	fprintf(stderr, "NETNSID := auto | POSITIVE-INT\n");
@@ -150,18 +152,24 @@ struct nsid_cache {
 	char			name[0];
 };
 
-#define NSIDMAP_SIZE		128
-#define NSID_HASH_NSID(nsid)	(nsid & (NSIDMAP_SIZE - 1))
-#define NSID_HASH_NAME(name)	(namehash(name) & (NSIDMAP_SIZE - 1))
+/* Both hashes double in size whenever they hold more entries than buckets */
+#define NSIDMAP_MIN		128
+#define NSID_HASH_NSID(nsid)	(nsid & (nsidmap_size - 1))
+#define NSID_HASH_NAME(name)	(namehash(name) & (nsidmap_size - 1))
 
-static struct hlist_head	nsid_head[NSIDMAP_SIZE];
-static struct hlist_head	name_head[NSIDMAP_SIZE];
+static struct hlist_head	*nsid_head;
+static struct hlist_head	*name_head;
+static unsigned int		nsidmap_size;
+static unsigned int		nsidmap_count;
 
 static struct nsid_cache *netns_map_get_by_nsid(int nsid)
 {
 	uint32_t h = NSID_HASH_NSID(nsid);
 	struct hlist_node *n;
 
+	if (!nsidmap_size)
+		return NULL;
+
 	hlist_for_each(n, &nsid_head[h]) {
 		struct nsid_cache *c = container_of(n, struct nsid_cache,
 						    nsid_hash);
@@ -186,6 +194,43 @@ char *get_name_from_nsid(int nsid)
 	return NULL;
 }
 
+static int netns_map_grow(void)
+{
+	unsigned int size = nsidmap_size ? nsidmap_size * 2 : NSIDMAP_MIN;
+	struct hlist_head *nsid, *name;
+	unsigned int i;
+
+	nsid = calloc(size, sizeof(*nsid));
+	name = calloc(size, sizeof(*name));
+	if (!nsid || !name) {
+		free(nsid);
+		free(name);
+		perror("calloc");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nsidmap_size; i++) {
+		struct hlist_node *n, *tmp;
+
+		hlist_for_each_safe(n, tmp, &nsid_head[i]) {
+			struct nsid_cache *c = container_of(n, struct nsid_cache,
+							    nsid_hash);
+
+			hlist_add_head(&c->nsid_hash,
+				       &nsid[c->nsid & (size - 1)]);
+			hlist_add_head(&c->name_hash,
+				       &name[namehash(c->name) & (size - 1)]);
+		}
+	}
+
+	free(nsid_head);
+	free(name_head);
+	nsid_head = nsid;
+	name_head = name;
+	nsidmap_size = size;
+	return 0;
+}
+
 static int netns_map_add(int nsid, const char *name)
 {
 	struct nsid_cache *c;
@@ -194,6 +239,9 @@ static int netns_map_add(int nsid, const char *name)
 	if (netns_map_get_by_nsid(nsid) != NULL)
 		return -EEXIST;
 
+	if (nsidmap_count >= nsidmap_size && netns_map_grow() < 0)
+		return -ENOMEM;
+
 	c = malloc(sizeof(*c) + strlen(name) + 1);
 	if (c == NULL) {
 		perror("malloc");
@@ -208,6 +256,7 @@ static int netns_map_add(int nsid, const char *name)
 	h = NSID_HASH_NAME(name);
 	hlist_add_head(&c->name_hash, &name_head[h]);
 
+	nsidmap_count++;
 	return 0;
 }
 
@@ -216,6 +265,7 @@ static void netns_map_del(struct nsid_cache *c)
 	hlist_del(&c->name_hash);
 	hlist_del(&c->nsid_hash);
 	free(c);
+	nsidmap_count--;
 }
 
 void netns_nsid_socket_init(void)
@@ -230,59 +280,176 @@ void netns_nsid_socket_init(void)
 
 }
 
-void netns_map_init(void)
+/* The nsids of all named namespaces, asked for in one pipelined burst of
+ * RTM_GETNSID requests rather than one round trip each
+ */
+#define NSID_BURST_WINDOW	64
+
+struct netns_nsids {
+	char		**name;
+	int		*nsid;
+	int		*fd;
+	int		count;
+	int		size;
+};
+
+static int netns_nsids_add(char *nsname, void *arg)
 {
-	static int initialized;
-	struct dirent *entry;
-	DIR *dir;
-	int nsid;
+	struct netns_nsids *ids = arg;
 
-	if (initialized || !ipnetns_have_nsid())
-		return;
+	if (ids->count == ids->size) {
+		int size = ids->size ? ids->size * 2 : 64;
+		char **name = realloc(ids->name, size * sizeof(*name));
 
-	dir = opendir(NETNS_RUN_DIR);
-	if (!dir)
-		return;
+		if (!name) {
+			perror("realloc");
+			return -1;
+		}
+		ids->name = name;
+		ids->size = size;
+	}
+	ids->name[ids->count] = strdup(nsname);
+	if (!ids->name[ids->count])
+		return -1;
+	ids->count++;
+	return 0;
+}
 
-	while ((entry = readdir(dir)) != NULL) {
-		if (strcmp(entry->d_name, ".") == 0)
-			continue;
-		if (strcmp(entry->d_name, "..") == 0)
+static int netns_nsids_ack(int tag, int error, const struct nlmsghdr *n,
+			   void *arg)
+{
+	struct netns_nsids *ids = arg;
+	struct rtattr *tb[NETNSA_MAX + 1];
+	struct rtgenmsg *rthdr;
+	int len;
+
+	if (n && n->nlmsg_type == RTM_NEWNSID) {
+		rthdr = NLMSG_DATA(n);
+		len = n->nlmsg_len - NLMSG_SPACE(sizeof(*rthdr));
+		if (len < 0)
+			return 0;
+		parse_rtattr(tb, NETNSA_MAX, NETNS_RTA(rthdr), len);
+		if (tb[NETNSA_NSID])
+			ids->nsid[tag] = rta_getattr_u32(tb[NETNSA_NSID]);
+		return 0;
+	}
+
+	/* the request is done with, and so is its file */
+	close(ids->fd[tag]);
+	ids->fd[tag] = -1;
+	return 0;
+}
+
+static void netns_nsids_free(struct netns_nsids *ids)
+{
+	int i;
+
+	for (i = 0; i < ids->count; i++)
+		free(ids->name[i]);
+	free(ids->name);
+	free(ids->nsid);
+	free(ids->fd);
+}
+
+static int netns_nsids_get(struct netns_nsids *ids)
+{
+	struct {
+		struct nlmsghdr n;
+		struct rtgenmsg g;
+		char            buf[64];
+	} req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg)),
+		.n.nlmsg_flags = NLM_F_REQUEST,
+		.n.nlmsg_type = RTM_GETNSID,
+		.g.rtgen_family = AF_UNSPEC,
+	};
+	int i;
+
+	memset(ids, 0, sizeof(*ids));
+	if (netns_foreach(netns_nsids_add, ids) < 0)
+		return -1;
+
+	ids->nsid = malloc((ids->count + 1) * sizeof(int));
+	ids->fd = malloc((ids->count + 1) * sizeof(int));
+	if (!ids->nsid || !ids->fd) {
+		perror("malloc");
+		return -1;
+	}
+	for (i = 0; i < ids->count; i++)
+		ids->nsid[i] = -1;
+
+	/* names only, on kernels without RTM_GETNSID */
+	if (!ids->count || !ipnetns_have_nsid())
+		return 0;
+
+	netns_nsid_socket_init();
+	if (rtnsh.fd < 0)
+		return 0;
+
+	if (rtnl_pipeline_init(&rtnsh, NSID_BURST_WINDOW,
+			       netns_nsids_ack, ids) < 0)
+		return -1;
+
+	for (i = 0; i < ids->count; i++) {
+		int err;
+
+		ids->fd[i] = netns_get_fd(ids->name[i]);
+		if (ids->fd[i] < 0)
 			continue;
-		nsid = get_netnsid_from_name(entry->d_name);
 
-		if (nsid >= 0)
-			netns_map_add(nsid, entry->d_name);
+		req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+		req.n.nlmsg_flags = NLM_F_REQUEST;
+		addattr32(&req.n, sizeof(req), NETNSA_FD, ids->fd[i]);
+
+		rtnl_pipeline_begin(&rtnsh, i);
+		err = rtnl_talk(&rtnsh, &req.n, NULL);
+		rtnl_pipeline_end(&rtnsh);
+		if (err < 0)
+			break;
 	}
-	closedir(dir);
+
+	/* rtnsh goes back to plain requests, ids is the caller's */
+	return rtnl_pipeline_destroy(&rtnsh) < 0 ? -1 : 0;
+}
+
+/* Fill the cache with the nsids of every named namespace */
+static void netns_map_fill(void)
+{
+	struct netns_nsids ids;
+	int i;
+
+	if (netns_nsids_get(&ids) == 0) {
+		for (i = 0; i < ids.count; i++)
+			if (ids.nsid[i] >= 0)
+				netns_map_add(ids.nsid[i], ids.name[i]);
+	}
+	netns_nsids_free(&ids);
+}
+
+void netns_map_init(void)
+{
+	static int initialized;
+
+	if (initialized || !ipnetns_have_nsid())
+		return;
+
+	netns_map_fill();
 	initialized = 1;
 }
 
 static int netns_get_name(int nsid, char *name)
 {
-	struct dirent *entry;
-	DIR *dir;
-	int id;
+	struct nsid_cache *c;
 
-	dir = opendir(NETNS_RUN_DIR);
-	if (!dir)
-		return -ENOENT;
+	/* pick up namespaces named since the cache was filled */
+	netns_map_fill();
 
-	while ((entry = readdir(dir)) != NULL) {
-		if (strcmp(entry->d_name, ".") == 0)
-			continue;
-		if (strcmp(entry->d_name, "..") == 0)
-			continue;
-		id = get_netnsid_from_name(entry->d_name);
+	c = netns_map_get_by_nsid(nsid);
+	if (!c)
+		return -ENOENT;
 
-		if (nsid == id) {
-			strcpy(name, entry->d_name);
-			closedir(dir);
-			return 0;
-		}
-	}
-	closedir(dir);
-	return -ENOENT;
+	strcpy(name, c->name);
+	return 0;
 }
 
 int print_nsid(struct nlmsghdr *n, void *arg)
@@ -364,35 +531,25 @@ static int netns_list_id(int argc, char **argv)
 
 static int netns_list(int argc, char **argv)
 {
-	struct dirent *entry;
-	DIR *dir;
-	int id;
+	struct netns_nsids ids;
+	int i;
 
-	dir = opendir(NETNS_RUN_DIR);
-	if (!dir)
+	if (netns_nsids_get(&ids) < 0) {
+		netns_nsids_free(&ids);
 		return 0;
+	}
 
 	new_json_obj(json);
-	while ((entry = readdir(dir)) != NULL) {
-		if (strcmp(entry->d_name, ".") == 0)
-			continue;
-		if (strcmp(entry->d_name, "..") == 0)
-			continue;
-
+	for (i = 0; i < ids.count; i++) {
 		open_json_object(NULL);
-		print_string(PRINT_ANY, "name",
-			     "%s", entry->d_name);
-		if (ipnetns_have_nsid()) {
-			id = get_netnsid_from_name(entry->d_name);
-			if (id >= 0)
-				print_uint(PRINT_ANY, "id",
-					   " (id: %d)", id);
-		}
+		print_string(PRINT_ANY, "name", "%s", ids.name[i]);
+		if (ids.nsid[i] >= 0)
+			print_uint(PRINT_ANY, "id", " (id: %d)", ids.nsid[i]);
 		print_string(PRINT_FP, NULL, "\n", NULL);
 		close_json_object();
 	}
-	closedir(dir);
 	delete_json_obj();
+	netns_nsids_free(&ids);
 	return 0;
 }
 
@@ -404,6 +561,230 @@ static int on_netns_exec(char *nsname, void *arg)
 	return 0;
 }
 
+/* ip -all -jobs N netns exec: run up to N namespaces at a time, and show
+ * what each of them printed in one piece, in namespace order
+ */
+struct netns_job {
+	char		*name;
+	pid_t		pid;
+	int		fd[2];		/* child's stdout and stderr */
+	char		*buf[2];
+	size_t		len[2];
+	size_t		size[2];
+	int		status;
+	bool		done;
+};
+
+struct netns_jobs {
+	struct netns_job *job;
+	int		count;
+	int		size;
+};
+
+static int netns_job_add(char *nsname, void *arg)
+{
+	struct netns_jobs *jobs = arg;
+
+	if (jobs->count == jobs->size) {
+		int size = jobs->size ? jobs->size * 2 : 64;
+		struct netns_job *job;
+
+		job = realloc(jobs->job, size * sizeof(*job));
+		if (!job) {
+			perror("realloc");
+			return -1;
+		}
+		jobs->job = job;
+		jobs->size = size;
+	}
+
+	memset(&jobs->job[jobs->count], 0, sizeof(struct netns_job));
+	jobs->job[jobs->count].name = strdup(nsname);
+	jobs->job[jobs->count].fd[0] = -1;
+	jobs->job[jobs->count].fd[1] = -1;
+	jobs->count++;
+	return 0;
+}
+
+static int netns_job_start(struct netns_job *job, char **argv)
+{
+	int out[2], err[2];
+
+	if (pipe2(out, O_CLOEXEC) < 0)
+		return -1;
+	if (pipe2(err, O_CLOEXEC) < 0) {
+		close(out[0]);
+		close(out[1]);
+		return -1;
+	}
+
+	job->pid = fork();
+	if (job->pid < 0) {
+		close(out[0]);
+		close(out[1]);
+		close(err[0]);
+		close(err[1]);
+		return -1;
+	}
+
+	if (job->pid == 0) {
+		dup2(out[1], STDOUT_FILENO);
+		dup2(err[1], STDERR_FILENO);
+		if (netns_switch(job->name))
+			_exit(1);
+		vrf_reset();
+		execvp(argv[0], argv);
+		fprintf(stderr, "exec of \"%s\" failed: %s\n",
+			argv[0], strerror(errno));
+		_exit(1);
+	}
+
+	close(out[1]);
+	close(err[1]);
+	job->fd[0] = out[0];
+	job->fd[1] = err[0];
+	return 0;
+}
+
+/* Read what is there from one of the child's pipes; false on EOF */
+static bool netns_job_read(struct netns_job *job, int i)
+{
+	ssize_t n;
+
+	if (job->size[i] - job->len[i] < 4096) {
+		size_t size = job->size[i] ? job->size[i] * 2 : 8192;
+		char *buf = realloc(job->buf[i], size);
+
+		if (!buf) {
+			perror("realloc");
+			exit(1);
+		}
+		job->buf[i] = buf;
+		job->size[i] = size;
+	}
+
+	n = read(job->fd[i], job->buf[i] + job->len[i],
+		 job->size[i] - job->len[i]);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return true;
+	if (n <= 0)
+		return false;
+	job->len[i] += n;
+	return true;
+}
+
+static void netns_job_show(struct netns_job *job)
+{
+	char label[NAME_MAX + 16];
+	struct iovec iov[2] = {
+		{ .iov_base = label },
+		{ .iov_base = job->buf[0], .iov_len = job->len[0] },
+	};
+
+	iov[0].iov_len = snprintf(label, sizeof(label),
+				  "\nnetns: %s\n", job->name);
+	if (writev(STDOUT_FILENO, iov, 2) < 0)
+		perror("writev");
+	if (job->len[1] &&
+	    write(STDERR_FILENO, job->buf[1], job->len[1]) < 0)
+		perror("write");
+
+	free(job->buf[0]);
+	free(job->buf[1]);
+	free(job->name);
+}
+
+static int netns_exec_jobs(char **argv)
+{
+	struct netns_jobs jobs = {};
+	struct pollfd *pfd;
+	int *owner;
+	int next = 0, shown = 0, running = 0;
+	int ret = 0;
+
+	if (netns_foreach(netns_job_add, &jobs) < 0)
+		return 0;
+
+	pfd = calloc(2 * netns_jobs, sizeof(*pfd));
+	owner = calloc(2 * netns_jobs, sizeof(*owner));
+	if (!pfd || !owner) {
+		perror("calloc");
+		exit(1);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	while (shown < jobs.count) {
+		int i, nfds = 0;
+
+		for (; running < netns_jobs && next < jobs.count; next++) {
+			struct netns_job *job = &jobs.job[next];
+
+			if (netns_job_start(job, argv) < 0) {
+				fprintf(stderr, "Cannot run in netns \"%s\": %s\n",
+					job->name, strerror(errno));
+				job->status = 1;
+				job->done = true;
+				continue;
+			}
+			running++;
+		}
+
+		for (i = 0; i < next; i++) {
+			int k;
+
+			for (k = 0; k < 2; k++) {
+				if (jobs.job[i].fd[k] < 0)
+					continue;
+				pfd[nfds].fd = jobs.job[i].fd[k];
+				pfd[nfds].events = POLLIN;
+				owner[nfds++] = 2 * i + k;
+			}
+		}
+
+		if (nfds && poll(pfd, nfds, -1) < 0 && errno != EINTR) {
+			perror("poll");
+			exit(1);
+		}
+
+		for (i = 0; i < nfds; i++) {
+			struct netns_job *job = &jobs.job[owner[i] / 2];
+			int k = owner[i] % 2;
+			int status;
+
+			if (!pfd[i].revents || netns_job_read(job, k))
+				continue;
+
+			close(job->fd[k]);
+			job->fd[k] = -1;
+			if (job->fd[!k] >= 0)
+				continue;
+
+			if (waitpid(job->pid, &status, 0) < 0) {
+				perror("waitpid");
+				exit(1);
+			}
+			if (WIFEXITED(status))
+				job->status = WEXITSTATUS(status);
+			else
+				job->status = 128 + WTERMSIG(status);
+			job->done = true;
+			running--;
+		}
+
+		for (; shown < next && jobs.job[shown].done; shown++) {
+			netns_job_show(&jobs.job[shown]);
+			if (jobs.job[shown].status > ret)
+				ret = jobs.job[shown].status;
+		}
+	}
+
+	free(owner);
+	free(pfd);
+	free(jobs.job);
+	return ret;
+}
+
 static int netns_exec(int argc, char **argv)
 {
 	/* Setup the proper environment for apps that are not netns
@@ -420,6 +801,9 @@ static int netns_exec(int argc, char **argv)
 		return -1;
 	}
 
+	if (do_all && netns_jobs)
+		return -netns_exec_jobs(argv);
+
 	if (do_all)
 		return do_each_netns(on_netns_exec, --argv, 1);
 
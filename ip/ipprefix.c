@@ -71,27 +71,33 @@ int print_prefix(struct nlmsghdr *n, void *arg)
 
 	parse_rtattr(tb, RTA_MAX, RTM_RTA(prefix), len);
 
+	open_json_object(NULL);
 	if (tb[PREFIX_ADDRESS]) {
-		fprintf(fp, "prefix %s/%u",
-		        rt_addr_n2a_rta(family, tb[PREFIX_ADDRESS]),
-			prefix->prefix_len);
+		print_color_string(PRINT_ANY, COLOR_INET6, "prefix",
+				   "prefix %s/",
+				   rt_addr_n2a_rta(family,
+						   tb[PREFIX_ADDRESS]));
+		print_uint(PRINT_ANY, "prefixlen", "%u", prefix->prefix_len);
 	}
-	fprintf(fp, "dev %s ", ll_index_to_name(prefix->prefix_ifindex));
+	print_string(PRINT_ANY, "dev", "dev %s ",
+		     ll_index_to_name(prefix->prefix_ifindex));
 
 	if (prefix->prefix_flags & IF_PREFIX_ONLINK)
-		fprintf(fp, "onlink ");
+		print_bool(PRINT_ANY, "onlink", "onlink ", true);
 	if (prefix->prefix_flags & IF_PREFIX_AUTOCONF)
-		fprintf(fp, "autoconf ");
+		print_bool(PRINT_ANY, "autoconf", "autoconf ", true);
 
 	if (tb[PREFIX_CACHEINFO]) {
 		const struct prefix_cacheinfo *pc
 			 = RTA_DATA(tb[PREFIX_CACHEINFO]);
 
-		fprintf(fp, "valid %u ", pc->valid_time);
-		fprintf(fp, "preferred %u ", pc->preferred_time);
+		print_uint(PRINT_ANY, "valid", "valid %u ", pc->valid_time);
+		print_uint(PRINT_ANY, "preferred", "preferred %u ",
+			   pc->preferred_time);
 	}
 
-	fprintf(fp, "\n");
+	print_string(PRINT_FP, NULL, "%s", "\n");
+	close_json_object();
 	fflush(fp);
 
 	return 0;
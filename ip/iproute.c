@@ -28,6 +28,7 @@
 #include "rt_names.h"
 #include "utils.h"
 #include "ip_common.h"
+#include "list.h"
 
 #ifndef RTAX_RTTVAR
 #define RTAX_RTTVAR RTAX_HOPS
@@ -64,6 +65,7 @@ static void usage(void)
 		"Usage: ip route { list | flush } SELECTOR\n"
 		"       ip route save SELECTOR\n"
 		"       ip route restore\n"
+		"       ip route sync FILE [ table TABLE_ID ]\n"
 		"       ip route showdump\n"
 		"       ip route get [ ROUTE_GET_FLAGS ] ADDRESS\n"
 		"                            [ from ADDRESS iif STRING ]\n"
@@ -71,6 +73,7 @@ static void usage(void)
 		"                            [ mark NUMBER ] [ vrf NAME ]\n"
 		"                            [ uid NUMBER ] [ ipproto PROTOCOL ]\n"
 		"                            [ sport NUMBER ] [ dport NUMBER ]\n"
+		"       ip route get -batch FILE\n"
 		"       ip route { add | del | change | append | replace } ROUTE\n"
 		"SELECTOR := [ root PREFIX ] [ match PREFIX ] [ exact PREFIX ]\n"
 		"            [ table TABLE_ID ] [ vrf NAME ] [ proto RTPROTO ]\n"
@@ -80,7 +83,7 @@ static void usage(void)
 		"             [ table TABLE_ID ] [ proto RTPROTO ]\n"
 		"             [ scope SCOPE ] [ metric METRIC ]\n"
 		"             [ ttl-propagate { enabled | disabled } ]\n"
-		"INFO_SPEC := NH OPTIONS FLAGS [ nexthop NH ]...\n"
+		"INFO_SPEC := { NH | nhid ID } OPTIONS FLAGS [ nexthop NH ]...\n"
 		"NH := [ encap ENCAPTYPE ENCAPHDR ] [ via [ FAMILY ] ADDRESS ]\n"
 		"	    [ dev STRING ] [ weight NUMBER ] NHFLAGS\n"
 		"FAMILY := [ inet | inet6 | mpls | bridge | link ]\n"
@@ -135,13 +138,93 @@ static struct
 	inet_prefix msrc;
 } filter;
 
+/* While "ip route sync" loads its route file, iproute_modify() stores
+ * the requests in here instead of sending them.
+ */
+static struct {
+	struct nlmsg_chain *routes;
+	__u32 table;
+} sync_load;
+
+/* Handle pipelining the lookups of "ip route get -batch" */
+static struct rtnl_handle *get_batch;
+
+/* Route deletes are pipelined on a socket of their own, the dump which
+ * produces them keeps running on rth meanwhile.
+ */
+#define FLUSH_WINDOW	1024
+
+static struct rtnl_handle rth_flush = { .fd = -1 };
+
+static struct {
+	unsigned int	sent;
+	unsigned int	failed;
+	int		error;
+	struct timespec	start;
+	struct timespec	last;
+} flush_stats;
+
+static double flush_elapsed(const struct timespec *since,
+			    const struct timespec *now)
+{
+	return (now->tv_sec - since->tv_sec) +
+	       (now->tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static void flush_progress(void)
+{
+	struct timespec now;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (flush_elapsed(&flush_stats.last, &now) < 1.)
+		return;
+
+	flush_stats.last = now;
+	elapsed = flush_elapsed(&flush_stats.start, &now);
+	fprintf(stderr, "*** %u entries deleted, %.0f/s ***\n",
+		flush_stats.sent - flush_stats.failed,
+		flush_stats.sent / elapsed);
+}
+
+static int flush_ack(int tag, int error, const struct nlmsghdr *n, void *arg)
+{
+	if (error) {
+		flush_stats.failed++;
+		flush_stats.error = error;
+	}
+	return 0;
+}
+
 static int flush_update(void)
 {
-	if (rtnl_send_check(&rth, filter.flushb, filter.flushp) < 0) {
+	struct iovec iov[FLUSH_WINDOW];
+	int len = filter.flushp;
+	struct nlmsghdr *n;
+	int iovlen = 0;
+	int ret;
+
+	for (n = (struct nlmsghdr *)filter.flushb; NLMSG_OK(n, len);
+	     n = NLMSG_NEXT(n, len)) {
+		iov[iovlen].iov_base = n;
+		iov[iovlen].iov_len = n->nlmsg_len;
+		iovlen++;
+	}
+	filter.flushp = 0;
+	if (!iovlen)
+		return 0;
+
+	rtnl_pipeline_begin(&rth_flush, 0);
+	ret = rtnl_talk_iov(&rth_flush, iov, iovlen, NULL);
+	rtnl_pipeline_end(&rth_flush);
+	if (ret < 0) {
 		perror("Failed to send flush request");
 		return -2;
 	}
-	filter.flushp = 0;
+	flush_stats.sent += iovlen;
+
+	if (show_stats)
+		flush_progress();
 	return 0;
 }
 
@@ -349,7 +432,7 @@ static void print_rtax_features(FILE *fp, unsigned int features)
 			    "features", "%#llx ", of);
 }
 
-static void print_rt_flags(FILE *fp, unsigned int flags)
+void print_rt_flags(FILE *fp, unsigned int flags)
 {
 	open_json_array(PRINT_JSON,
 			is_json_context() ?  "flags" : "");
@@ -394,8 +477,7 @@ static void print_rt_pref(FILE *fp, unsigned int pref)
 	}
 }
 
-static void print_rta_if(FILE *fp, const struct rtattr *rta,
-			const char *prefix)
+void print_rta_if(FILE *fp, const struct rtattr *rta, const char *prefix)
 {
 	const char *ifname = ll_index_to_name(rta_getattr_u32(rta));
 
@@ -532,17 +614,16 @@ static void print_rta_newdst(FILE *fp, const struct rtmsg *r,
 	}
 }
 
-static void print_rta_gateway(FILE *fp, const struct rtmsg *r,
-			      const struct rtattr *rta)
+void print_rta_gateway(FILE *fp, unsigned char family,
+		       const struct rtattr *rta)
 {
-	const char *gateway = format_host_rta(r->rtm_family, rta);
+	const char *gateway = format_host_rta(family, rta);
 
 	if (is_json_context())
 		print_string(PRINT_JSON, "gateway", NULL, gateway);
 	else {
 		fprintf(fp, "via ");
-		print_color_string(PRINT_FP,
-				   ifa_family_color(r->rtm_family),
+		print_color_string(PRINT_FP, ifa_family_color(family),
 				   NULL, "%s ", gateway);
 	}
 }
@@ -679,7 +760,8 @@ static void print_rta_multipath(FILE *fp, const struct rtmsg *r,
 			if (tb[RTA_NEWDST])
 				print_rta_newdst(fp, r, tb[RTA_NEWDST]);
 			if (tb[RTA_GATEWAY])
-				print_rta_gateway(fp, r, tb[RTA_GATEWAY]);
+				print_rta_gateway(fp, r->rtm_family,
+						  tb[RTA_GATEWAY]);
 			if (tb[RTA_VIA])
 				print_rta_via(fp, tb[RTA_VIA]);
 			if (tb[RTA_FLOW])
@@ -821,8 +903,12 @@ int print_route(struct nlmsghdr *n, void *arg)
 			     rtnl_dsfield_n2a(r->rtm_tos, b1, sizeof(b1)));
 	}
 
+	if (tb[RTA_NH_ID])
+		print_uint(PRINT_ANY, "nhid", "nhid %u ",
+			   rta_getattr_u32(tb[RTA_NH_ID]));
+
 	if (tb[RTA_GATEWAY] && filter.rvia.bitlen != host_len)
-		print_rta_gateway(fp, r, tb[RTA_GATEWAY]);
+		print_rta_gateway(fp, r->rtm_family, tb[RTA_GATEWAY]);
 
 	if (tb[RTA_VIA])
 		print_rta_via(fp, tb[RTA_VIA]);
@@ -997,7 +1083,8 @@ static int parse_one_nh(struct nlmsghdr *n, struct rtmsg *r,
 		} else if (strcmp(*argv, "encap") == 0) {
 			int old_len = rta->rta_len;
 
-			if (lwt_parse_encap(rta, len, &argc, &argv))
+			if (lwt_parse_encap(rta, len, &argc, &argv,
+					    RTA_ENCAP, RTA_ENCAP_TYPE))
 				return -1;
 			rtnh->rtnh_len += rta->rta_len - old_len;
 		} else if (strcmp(*argv, "as") == 0) {
@@ -1076,6 +1163,7 @@ static int iproute_modify(int cmd, unsigned int flags, int argc, char **argv)
 	int gw_ok = 0;
 	int dst_ok = 0;
 	int nhs_ok = 0;
+	int nhid_ok = 0;
 	int scope_ok = 0;
 	int table_ok = 0;
 	int raw = 0;
@@ -1358,6 +1446,14 @@ static int iproute_modify(int cmd, unsigned int flags, int argc, char **argv)
 		} else if (strcmp(*argv, "nexthop") == 0) {
 			nhs_ok = 1;
 			break;
+		} else if (strcmp(*argv, "nhid") == 0) {
+			__u32 id;
+
+			NEXT_ARG();
+			if (get_u32(&id, *argv, 0))
+				invarg("\"id\" value is invalid\n", *argv);
+			addattr32(&req.n, sizeof(req), RTA_NH_ID, id);
+			nhid_ok = 1;
 		} else if (matches(*argv, "protocol") == 0) {
 			__u32 prot;
 
@@ -1416,7 +1512,8 @@ static int iproute_modify(int cmd, unsigned int flags, int argc, char **argv)
 			rta->rta_type = RTA_ENCAP;
 			rta->rta_len = RTA_LENGTH(0);
 
-			lwt_parse_encap(rta, sizeof(buf), &argc, &argv);
+			lwt_parse_encap(rta, sizeof(buf), &argc, &argv,
+					RTA_ENCAP, RTA_ENCAP_TYPE);
 
 			if (rta->rta_len > RTA_LENGTH(0))
 				addraw_l(&req.n, 1024
@@ -1497,7 +1594,15 @@ static int iproute_modify(int cmd, unsigned int flags, int argc, char **argv)
 	if (req.r.rtm_family == AF_UNSPEC)
 		req.r.rtm_family = AF_INET;
 
-	if (!table_ok) {
+	if (!table_ok && sync_load.routes) {
+		if (sync_load.table < 256)
+			req.r.rtm_table = sync_load.table;
+		else {
+			req.r.rtm_table = RT_TABLE_UNSPEC;
+			addattr32(&req.n, sizeof(req), RTA_TABLE,
+				  sync_load.table);
+		}
+	} else if (!table_ok) {
 		if (req.r.rtm_type == RTN_LOCAL ||
 		    req.r.rtm_type == RTN_BROADCAST ||
 		    req.r.rtm_type == RTN_NAT ||
@@ -1519,7 +1624,7 @@ static int iproute_modify(int cmd, unsigned int flags, int argc, char **argv)
 			 req.r.rtm_type == RTN_UNSPEC) {
 			if (cmd == RTM_DELROUTE)
 				req.r.rtm_scope = RT_SCOPE_NOWHERE;
-			else if (!gw_ok && !nhs_ok)
+			else if (!gw_ok && !nhs_ok && !nhid_ok)
 				req.r.rtm_scope = RT_SCOPE_LINK;
 		}
 	}
@@ -1527,6 +1632,9 @@ static int iproute_modify(int cmd, unsigned int flags, int argc, char **argv)
 	if (!type_ok && req.r.rtm_family == AF_MPLS)
 		req.r.rtm_type = RTN_UNICAST;
 
+	if (sync_load.routes)
+		return store_nlmsg(&req.n, sync_load.routes);
+
 	if (rtnl_talk(&rth, &req.n, NULL) < 0)
 		return -2;
 
@@ -1604,8 +1712,9 @@ static int save_route_prep(void)
 
 static int iproute_flush(int family, rtnl_filter_t filter_fn)
 {
-	time_t start = time(0);
-	char flushb[4096-512];
+	/* room for fewer messages than FLUSH_WINDOW */
+	char flushb[16384];
+	struct timespec now;
 	int round = 0;
 	int ret;
 
@@ -1619,20 +1728,43 @@ static int iproute_flush(int family, rtnl_filter_t filter_fn)
 			return 0;
 	}
 
+	if (rtnl_open(&rth_flush, 0) < 0)
+		return -2;
+	rth_flush.flags |= RTNL_HANDLE_F_SUPPRESS_NLERR;
+	if (rtnl_pipeline_init(&rth_flush, FLUSH_WINDOW, flush_ack, NULL) < 0) {
+		ret = -2;
+		goto out;
+	}
+
 	filter.flushb = flushb;
 	filter.flushp = 0;
 	filter.flushe = sizeof(flushb);
 
 	for (;;) {
+		memset(&flush_stats, 0, sizeof(flush_stats));
+		clock_gettime(CLOCK_MONOTONIC, &flush_stats.start);
+		flush_stats.last = flush_stats.start;
+
 		if (rtnl_routedump_req(&rth, family, NULL) < 0) {
 			perror("Cannot send dump request");
-			return -2;
+			ret = -2;
+			goto out;
 		}
 		filter.flushed = 0;
 		if (rtnl_dump_filter(&rth, filter_fn, stdout) < 0) {
 			fprintf(stderr, "Flush terminated\n");
-			return -2;
+			ret = -2;
+			goto out;
+		}
+		ret = flush_update();
+		if (ret < 0)
+			goto out;
+		if (rtnl_pipeline_drain(&rth_flush) < 0) {
+			fprintf(stderr, "Flush terminated\n");
+			ret = -2;
+			goto out;
 		}
+
 		if (filter.flushed == 0) {
 			if (show_stats) {
 				if (round == 0 &&
@@ -1643,25 +1775,41 @@ static int iproute_flush(int family, rtnl_filter_t filter_fn)
 					       round, round > 1 ? "s" : "");
 			}
 			fflush(stdout);
-			return 0;
+			ret = 0;
+			goto out;
 		}
 		round++;
-		ret = flush_update();
-		if (ret < 0)
-			return ret;
-
-		if (time(0) - start > 30) {
-			printf("\n*** Flush not completed after %ld seconds, %d entries remain ***\n",
-			       (long)(time(0) - start), filter.flushed);
-			return -1;
-		}
 
 		if (show_stats) {
-			printf("\n*** Round %d, deleting %d entries ***\n",
-			       round, filter.flushed);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			printf("\n*** Round %d, deleted %d entries in %.3fs, %.0f/s ***\n",
+			       round, filter.flushed - flush_stats.failed,
+			       flush_elapsed(&flush_stats.start, &now),
+			       filter.flushed /
+			       flush_elapsed(&flush_stats.start, &now));
 			fflush(stdout);
 		}
+
+		/* dump again until nothing is left, the dump may have been
+		 * interrupted or routes added meanwhile
+		 */
+		if (max_flush_loops && round >= max_flush_loops) {
+			if (flush_stats.failed)
+				printf("\n*** Flush not completed after %d rounds, %u deletes failed: %s ***\n",
+				       round, flush_stats.failed,
+				       strerror(-flush_stats.error));
+			else
+				printf("\n*** Flush not completed after %d rounds ***\n",
+				       round);
+			ret = -1;
+			goto out;
+		}
 	}
+
+out:
+	filter.flushb = NULL;
+	rtnl_close(&rth_flush);
+	return ret;
 }
 
 static int iproute_dump_filter(struct nlmsghdr *nlh, int reqlen)
@@ -1911,6 +2059,8 @@ static int iproute_list_flush_or_save(int argc, char **argv, int action)
 }
 
 
+static int iproute_get_batch(const char *name);
+
 static int iproute_get(int argc, char **argv)
 {
 	struct {
@@ -1932,6 +2082,9 @@ static int iproute_get(int argc, char **argv)
 	unsigned int mark = 0;
 	bool address_found = false;
 
+	if (argc == 2 && strcmp(*argv, "-batch") == 0)
+		return iproute_get_batch(argv[1]);
+
 	iproute_reset_filter(0);
 	filter.cloned = 2;
 
@@ -2074,6 +2227,17 @@ static int iproute_get(int argc, char **argv)
 	if (fib_match)
 		req.r.rtm_flags |= RTM_F_FIB_MATCH;
 
+	if (get_batch) {
+		if (connected) {
+			fprintf(stderr, "\"connected\" is not supported with -batch\n");
+			return -1;
+		}
+		/* the reply goes to get_batch_ack() */
+		if (rtnl_talk(get_batch, &req.n, NULL) < 0)
+			return -2;
+		return 0;
+	}
+
 	if (rtnl_talk(&rth, &req.n, &answer) < 0)
 		return -2;
 
@@ -2140,6 +2304,90 @@ static int iproute_get(int argc, char **argv)
 	return 0;
 }
 
+struct get_batch_ctx {
+	const char	*name;
+	int		failed;
+};
+
+static int get_batch_ack(int tag, int error, const struct nlmsghdr *n,
+			 void *arg)
+{
+	struct get_batch_ctx *ctx = arg;
+
+	if (error) {
+		fprintf(stderr, "%s:%d: %s\n", ctx->name, tag, strerror(-error));
+		ctx->failed++;
+	} else if (n->nlmsg_type == RTM_NEWROUTE) {
+		print_route((struct nlmsghdr *)n, stdout);
+	}
+	return 0;
+}
+
+/* Looks up the routes of FILE, one "ip route get" per line. The requests
+ * are pipelined, so the replies still come in the order of the file.
+ */
+static int iproute_get_batch(const char *name)
+{
+	struct rtnl_handle rth_get = { .fd = -1 };
+	struct get_batch_ctx ctx = { .name = name };
+	char *line = NULL;
+	size_t len = 0;
+	FILE *fp = stdin;
+	int ret = 0;
+
+	if (strcmp(name, "-") != 0) {
+		fp = fopen(name, "r");
+		if (!fp) {
+			fprintf(stderr, "Cannot open file \"%s\" for reading: %s\n",
+				name, strerror(errno));
+			return -1;
+		}
+	}
+
+	if (rtnl_open(&rth_get, 0) < 0 ||
+	    rtnl_pipeline_init(&rth_get, IP_PIPELINE_WINDOW, get_batch_ack,
+			       &ctx) < 0) {
+		ret = -2;
+		goto out;
+	}
+	rth_get.flags |= RTNL_HANDLE_F_SUPPRESS_NLERR;
+
+	new_json_obj(json);
+	get_batch = &rth_get;
+
+	cmdlineno = 0;
+	while (getcmdline(&line, &len, fp) != -1) {
+		char *largv[100];
+		int largc;
+
+		largc = makeargs(line, largv, 100);
+		if (largc == 0)
+			continue;
+
+		rtnl_pipeline_begin(&rth_get, cmdlineno);
+		ret = iproute_get(largc, largv);
+		rtnl_pipeline_end(&rth_get);
+		if (ret < 0) {
+			fprintf(stderr, "Invalid lookup %s:%d\n", name, cmdlineno);
+			break;
+		}
+	}
+
+	if (rtnl_pipeline_drain(&rth_get) < 0)
+		ret = -2;
+	get_batch = NULL;
+	delete_json_obj();
+
+	if (!ret && ctx.failed)
+		ret = -2;
+out:
+	rtnl_close(&rth_get);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	return ret;
+}
+
 static int rtattr_cmp(const struct rtattr *rta1, const struct rtattr *rta2)
 {
 	if (!rta1 || !rta2 || rta1->rta_len != rta2->rta_len)
@@ -2148,42 +2396,45 @@ static int rtattr_cmp(const struct rtattr *rta1, const struct rtattr *rta2)
 	return memcmp(RTA_DATA(rta1), RTA_DATA(rta2), RTA_PAYLOAD(rta1));
 }
 
+/* Routes of a dump, sorted by the order they have to be restored in:
+ * 0. ones for local addresses,
+ * 1. ones for local networks,
+ * 2. others (remote networks/hosts).
+ */
+#define RESTORE_PRIO_MAX	3
+
 static int restore_handler(struct rtnl_ctrl_data *ctrl,
 			   struct nlmsghdr *n, void *arg)
 {
+	struct nlmsg_chain *prio_list = arg;
 	struct rtmsg *r = NLMSG_DATA(n);
 	struct rtattr *tb[RTA_MAX+1];
 	int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*r));
-	int ret, prio = *(int *)arg;
-
-	parse_rtattr(tb, RTA_MAX, RTM_RTA(r), len);
+	int prio;
 
-	/* Restore routes in correct order:
-	 * 0. ones for local addresses,
-	 * 1. ones for local networks,
-	 * 2. others (remote networks/hosts).
-	 */
-	if (!prio && !tb[RTA_GATEWAY] && (!tb[RTA_PREFSRC] ||
-	    !rtattr_cmp(tb[RTA_PREFSRC], tb[RTA_DST])))
-		goto restore;
-	else if (prio == 1 && !tb[RTA_GATEWAY] && tb[RTA_PREFSRC] &&
-		 rtattr_cmp(tb[RTA_PREFSRC], tb[RTA_DST]))
-		goto restore;
-	else if (prio == 2 && tb[RTA_GATEWAY])
-		goto restore;
+	if (len < 0)
+		return -1;
 
-	return 0;
+	parse_rtattr(tb, RTA_MAX, RTM_RTA(r), len);
 
-restore:
-	n->nlmsg_flags |= NLM_F_REQUEST | NLM_F_CREATE | NLM_F_ACK;
+	if (tb[RTA_GATEWAY])
+		prio = 2;
+	else if (!tb[RTA_PREFSRC] || !rtattr_cmp(tb[RTA_PREFSRC], tb[RTA_DST]))
+		prio = 0;
+	else
+		prio = 1;
 
-	ll_init_map(&rth);
+	return store_nlmsg(n, &prio_list[prio]);
+}
 
-	ret = rtnl_talk(&rth, n, NULL);
-	if ((ret < 0) && (errno == EEXIST))
-		ret = 0;
+static int restore_ack(int tag, int error, const struct nlmsghdr *n,
+		       void *arg)
+{
+	int *failed = arg;
 
-	return ret;
+	if (error && error != -EEXIST)
+		(*failed)++;
+	return 0;
 }
 
 static int route_dump_check_magic(void)
@@ -2207,31 +2458,56 @@ static int route_dump_check_magic(void)
 
 static int iproute_restore(void)
 {
-	int pos, prio;
+	struct nlmsg_chain prio_list[RESTORE_PRIO_MAX] = {};
+	struct rtnl_handle rth_restore = { .fd = -1 };
+	int failed = 0;
+	int prio, ret = 0;
 
 	if (route_dump_check_magic())
 		return -1;
 
-	pos = ftell(stdin);
-	if (pos == -1) {
-		perror("Failed to restore: ftell");
-		return -1;
+	/* read the dump once, stdin does not need to be seekable */
+	if (rtnl_from_file(stdin, &restore_handler, prio_list)) {
+		ret = -2;
+		goto out;
 	}
 
-	for (prio = 0; prio < 3; prio++) {
-		int err;
+	ll_init_map(&rth);
 
-		err = rtnl_from_file(stdin, &restore_handler, &prio);
-		if (err)
-			return -2;
+	/* a handle of its own, rth may be pipelining a batch already */
+	if (rtnl_open(&rth_restore, 0) < 0 ||
+	    rtnl_pipeline_init(&rth_restore, IP_PIPELINE_WINDOW, restore_ack,
+			       &failed) < 0) {
+		ret = -1;
+		goto out;
+	}
 
-		if (fseek(stdin, pos, SEEK_SET) == -1) {
-			perror("Failed to restore: fseek");
-			return -1;
+	/* a class must be in place before the next one is restored */
+	for (prio = 0; prio < RESTORE_PRIO_MAX && !failed; prio++) {
+		struct nlmsg_list *l;
+
+		rtnl_pipeline_begin(&rth_restore, prio);
+		for (l = prio_list[prio].head; l && !failed; l = l->next) {
+			struct nlmsghdr *n = &l->h;
+
+			n->nlmsg_flags |= NLM_F_REQUEST | NLM_F_CREATE |
+					  NLM_F_ACK;
+			if (rtnl_talk(&rth_restore, n, NULL) < 0)
+				failed++;
 		}
+		rtnl_pipeline_end(&rth_restore);
+
+		if (rtnl_pipeline_drain(&rth_restore) < 0)
+			failed++;
 	}
 
-	return 0;
+	if (failed)
+		ret = -2;
+out:
+	for (prio = 0; prio < RESTORE_PRIO_MAX; prio++)
+		free_nlmsg_chain(&prio_list[prio]);
+	rtnl_close(&rth_restore);
+	return ret;
 }
 
 static int show_handler(struct rtnl_ctrl_data *ctrl,
@@ -2252,6 +2528,452 @@ static int iproute_showdump(void)
 	return 0;
 }
 
+/* Routes of "ip route sync" are told apart the way the FIB does it */
+struct sync_key {
+	__u32	table;
+	__u32	metric;
+	__u8	family;
+	__u8	dst_len;
+	__u8	tos;
+	__u8	dst[16];
+};
+
+enum {
+	SYNC_ADD,
+	SYNC_CHANGE,
+	SYNC_KEEP,
+};
+
+struct sync_route {
+	struct hlist_node	hash;
+	struct sync_key		key;
+	struct nlmsghdr		*n;
+	int			state;
+};
+
+struct sync_set {
+	struct nlmsg_chain	desired;
+	struct nlmsg_chain	stale;
+	struct sync_route	*routes;
+	struct hlist_head	*hash;
+	unsigned int		size;
+	unsigned int		count;
+	__u32			table;
+	__u64			families;	/* 1 << family, of the file */
+	int			failed;
+};
+
+/* metric the kernel gives IPv6 routes added without one */
+#define SYNC_IP6_METRIC		1024
+
+/* Attributes which make two routes with the same key differ. The kernel
+ * fills in the implied ones by itself, so they only count when given.
+ * Those of the nexthop are reported for routes using a nexthop object
+ * as well, only its id counts then.
+ */
+static const struct {
+	unsigned short	type;
+	bool		implied;
+	bool		nh;
+} sync_attrs[] = {
+	{ RTA_SRC },
+	{ RTA_GATEWAY,		false,	true },
+	{ RTA_VIA,		false,	true },
+	{ RTA_OIF,		true,	true },
+	{ RTA_PREFSRC },
+	{ RTA_FLOW },
+	{ RTA_METRICS },
+	{ RTA_MULTIPATH,	false,	true },
+	{ RTA_NEWDST },
+	{ RTA_ENCAP_TYPE,	false,	true },
+	{ RTA_ENCAP,		false,	true },
+	{ RTA_PREF,		true },
+	{ RTA_TTL_PROPAGATE },
+	{ RTA_NH_ID },
+};
+
+static int sync_parse(struct nlmsghdr *n, struct sync_key *key,
+		      struct rtattr **tb)
+{
+	struct rtmsg *r = NLMSG_DATA(n);
+	int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*r));
+
+	if (len < 0)
+		return -1;
+
+	parse_rtattr(tb, RTA_MAX, RTM_RTA(r), len);
+
+	memset(key, 0, sizeof(*key));
+	key->table = rtm_get_table(r, tb);
+	key->family = r->rtm_family;
+	key->dst_len = r->rtm_dst_len;
+	key->tos = r->rtm_tos;
+	if (tb[RTA_DST] && RTA_PAYLOAD(tb[RTA_DST]) <= sizeof(key->dst))
+		memcpy(key->dst, RTA_DATA(tb[RTA_DST]),
+		       RTA_PAYLOAD(tb[RTA_DST]));
+	if (tb[RTA_PRIORITY])
+		key->metric = rta_getattr_u32(tb[RTA_PRIORITY]);
+	else if (key->family == AF_INET6)
+		key->metric = SYNC_IP6_METRIC;
+	return 0;
+}
+
+static unsigned int sync_hash(const struct sync_set *set,
+			      const struct sync_key *key)
+{
+	const unsigned char *p = (const unsigned char *)key;
+	unsigned int h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < sizeof(*key); i++)
+		h = (h ^ p[i]) * 16777619U;
+
+	return h & (set->size - 1);
+}
+
+static struct sync_route *sync_lookup(const struct sync_set *set,
+				      const struct sync_key *key)
+{
+	struct sync_route *sr;
+
+	hlist_for_each_entry(sr, &set->hash[sync_hash(set, key)], hash)
+		if (!memcmp(&sr->key, key, sizeof(*key)))
+			return sr;
+
+	return NULL;
+}
+
+/* Loads the routes to have in the table, one "ip route add" per line */
+static int sync_load_file(struct sync_set *set, const char *name)
+{
+	struct rtattr *tb[RTA_MAX+1];
+	struct nlmsg_list *l;
+	char *line = NULL;
+	size_t len = 0;
+	unsigned int i;
+	FILE *fp = stdin;
+	int ret = 0;
+
+	if (strcmp(name, "-") != 0) {
+		fp = fopen(name, "r");
+		if (!fp) {
+			fprintf(stderr, "Cannot open file \"%s\" for reading: %s\n",
+				name, strerror(errno));
+			return -1;
+		}
+	}
+
+	sync_load.routes = &set->desired;
+	sync_load.table = set->table;
+
+	cmdlineno = 0;
+	while (getcmdline(&line, &len, fp) != -1) {
+		char *largv[100];
+		int largc;
+
+		largc = makeargs(line, largv, 100);
+		if (largc == 0)
+			continue;
+
+		if (iproute_modify(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE,
+				   largc, largv) < 0) {
+			fprintf(stderr, "Invalid route %s:%d\n", name, cmdlineno);
+			ret = -1;
+			break;
+		}
+		set->count++;
+	}
+
+	sync_load.routes = NULL;
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	if (ret < 0)
+		return ret;
+
+	for (set->size = 256; set->size < set->count; set->size <<= 1)
+		;
+	set->hash = calloc(set->size, sizeof(*set->hash));
+	set->routes = calloc(set->count, sizeof(*set->routes));
+	if (!set->hash || !set->routes) {
+		perror("Cannot allocate route index");
+		return -1;
+	}
+
+	for (l = set->desired.head, i = 0; l; l = l->next, i++) {
+		struct sync_route *sr = &set->routes[i];
+
+		sr->n = &l->h;
+		sync_parse(sr->n, &sr->key, tb);
+		if (sr->key.table != set->table) {
+			SPRINT_BUF(b1);
+
+			fprintf(stderr, "Route %d of \"%s\" is not in table %s\n",
+				i + 1, name,
+				rtnl_rttable_n2a(set->table, b1, sizeof(b1)));
+			return -1;
+		}
+		if (sync_lookup(set, &sr->key)) {
+			fprintf(stderr, "Route %d of \"%s\" is a duplicate\n",
+				i + 1, name);
+			return -1;
+		}
+		if (sr->key.family < 64)
+			set->families |= 1ULL << sr->key.family;
+		hlist_add_head(&sr->hash, &set->hash[sync_hash(set, &sr->key)]);
+	}
+
+	return 0;
+}
+
+/* Nexthops of a multipath route, in the order they were given. The
+ * kernel fills in the interface and flags like RTNH_F_LINKDOWN of each
+ * hop, so only the interface given and RTNH_F_ONLINK count.
+ */
+static bool sync_multipath_differs(const struct rtattr *want,
+				   const struct rtattr *have)
+{
+	static const unsigned short attrs[] = {
+		RTA_GATEWAY, RTA_VIA, RTA_FLOW, RTA_ENCAP_TYPE, RTA_ENCAP,
+	};
+	const struct rtnexthop *w = RTA_DATA(want);
+	const struct rtnexthop *h = RTA_DATA(have);
+	int wlen = RTA_PAYLOAD(want);
+	int hlen = RTA_PAYLOAD(have);
+
+	while (RTNH_OK(w, wlen) && RTNH_OK(h, hlen)) {
+		struct rtattr *wtb[RTA_MAX+1], *htb[RTA_MAX+1];
+		unsigned int i;
+
+		if (w->rtnh_hops != h->rtnh_hops ||
+		    (w->rtnh_flags & RTNH_F_ONLINK) !=
+		    (h->rtnh_flags & RTNH_F_ONLINK) ||
+		    (w->rtnh_ifindex && w->rtnh_ifindex != h->rtnh_ifindex))
+			return true;
+
+		parse_rtattr(wtb, RTA_MAX, RTNH_DATA(w),
+			     w->rtnh_len - sizeof(*w));
+		parse_rtattr(htb, RTA_MAX, RTNH_DATA(h),
+			     h->rtnh_len - sizeof(*h));
+		for (i = 0; i < ARRAY_SIZE(attrs); i++) {
+			if (!wtb[attrs[i]] != !htb[attrs[i]])
+				return true;
+			if (wtb[attrs[i]] &&
+			    rtattr_cmp(wtb[attrs[i]], htb[attrs[i]]))
+				return true;
+		}
+
+		wlen -= NLMSG_ALIGN(w->rtnh_len);
+		hlen -= NLMSG_ALIGN(h->rtnh_len);
+		w = RTNH_NEXT(w);
+		h = RTNH_NEXT(h);
+	}
+
+	return RTNH_OK(w, wlen) || RTNH_OK(h, hlen);
+}
+
+static bool sync_route_differs(struct nlmsghdr *want, struct nlmsghdr *have,
+			       struct rtattr **have_tb)
+{
+	struct rtmsg *rw = NLMSG_DATA(want);
+	struct rtmsg *rh = NLMSG_DATA(have);
+	struct rtattr *want_tb[RTA_MAX+1];
+	struct sync_key key;
+	unsigned int i;
+
+	if (rw->rtm_type != rh->rtm_type ||
+	    rw->rtm_protocol != rh->rtm_protocol ||
+	    rw->rtm_scope != rh->rtm_scope ||
+	    rw->rtm_src_len != rh->rtm_src_len ||
+	    (rw->rtm_flags & RTNH_F_ONLINK) != (rh->rtm_flags & RTNH_F_ONLINK))
+		return true;
+
+	sync_parse(want, &key, want_tb);
+
+	for (i = 0; i < ARRAY_SIZE(sync_attrs); i++) {
+		struct rtattr *w = want_tb[sync_attrs[i].type];
+		struct rtattr *h = have_tb[sync_attrs[i].type];
+
+		if (!w && sync_attrs[i].implied)
+			continue;
+		if (sync_attrs[i].nh && want_tb[RTA_NH_ID])
+			continue;
+		if (!w != !h)
+			return true;
+		if (!w)
+			continue;
+		if (sync_attrs[i].type == RTA_MULTIPATH) {
+			if (sync_multipath_differs(w, h))
+				return true;
+		} else if (rtattr_cmp(w, h)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int sync_handler(struct nlmsghdr *n, void *arg)
+{
+	struct sync_set *set = arg;
+	struct rtmsg *r = NLMSG_DATA(n);
+	struct rtattr *tb[RTA_MAX+1];
+	struct sync_route *sr;
+	struct sync_key key;
+
+	if (n->nlmsg_type != RTM_NEWROUTE)
+		return 0;
+	if (sync_parse(n, &key, tb) < 0)
+		return -1;
+
+	/* leave alone what the kernel maintains by itself */
+	if (r->rtm_flags & RTM_F_CLONED || r->rtm_protocol == RTPROT_KERNEL)
+		return 0;
+	if (key.table != set->table)
+		return 0;
+	/* a family the file has no routes of is not synced */
+	if (key.family >= 64 || !(set->families & (1ULL << key.family)))
+		return 0;
+
+	sr = sync_lookup(set, &key);
+	if (!sr || sr->state != SYNC_ADD)
+		return store_nlmsg(n, &set->stale);
+
+	sr->state = sync_route_differs(sr->n, n, tb) ? SYNC_CHANGE : SYNC_KEEP;
+	return 0;
+}
+
+static int sync_ack(int tag, int error, const struct nlmsghdr *n, void *arg)
+{
+	struct sync_set *set = arg;
+
+	if (error)
+		set->failed++;
+	return 0;
+}
+
+static int iproute_sync(int argc, char **argv)
+{
+	struct rtnl_handle rth_sync = { .fd = -1 };
+	struct sync_set set = { .table = RT_TABLE_MAIN };
+	unsigned int counts[SYNC_KEEP + 1] = {};
+	unsigned int deleted = 0;
+	const char *name = NULL;
+	struct nlmsg_list *l;
+	unsigned int i;
+	int pass, ret = 0;
+
+	while (argc > 0) {
+		if (matches(*argv, "table") == 0) {
+			NEXT_ARG();
+			if (rtnl_rttable_a2n(&set.table, *argv))
+				invarg("\"table\" value is invalid\n", *argv);
+		} else if (matches(*argv, "help") == 0) {
+			usage();
+		} else {
+			if (name)
+				duparg2("FILE", *argv);
+			name = *argv;
+		}
+		argc--; argv++;
+	}
+
+	if (!name)
+		usage();
+
+	if (sync_load_file(&set, name) < 0) {
+		ret = -1;
+		goto out;
+	}
+	if (preferred_family != AF_UNSPEC)
+		set.families = 1ULL << preferred_family;
+	if (!set.families) {
+		fprintf(stderr, "No routes in \"%s\", use -4 or -6 to empty a table\n",
+			name);
+		ret = -1;
+		goto out;
+	}
+
+	if (rtnl_routedump_req(&rth, preferred_family, NULL) < 0) {
+		perror("Cannot send dump request");
+		ret = -2;
+		goto out;
+	}
+	if (rtnl_dump_filter(&rth, sync_handler, &set) < 0) {
+		fprintf(stderr, "Dump terminated\n");
+		ret = -2;
+		goto out;
+	}
+
+	if (rtnl_open(&rth_sync, 0) < 0 ||
+	    rtnl_pipeline_init(&rth_sync, IP_PIPELINE_WINDOW, sync_ack,
+			       &set) < 0) {
+		ret = -2;
+		goto out;
+	}
+
+	/* routes through a gateway may depend on direct ones being added,
+	 * deletes go last so that no traffic is left without a route.
+	 */
+	for (pass = 0; pass < 3 && !set.failed; pass++) {
+		rtnl_pipeline_begin(&rth_sync, pass);
+		if (pass < 2) {
+			for (i = 0; i < set.count; i++) {
+				struct sync_route *sr = &set.routes[i];
+				struct rtattr *tb[RTA_MAX+1];
+				struct sync_key key;
+				bool direct;
+
+				if (sr->state == SYNC_KEEP)
+					continue;
+
+				sync_parse(sr->n, &key, tb);
+				direct = !tb[RTA_GATEWAY] && !tb[RTA_VIA] &&
+					 !tb[RTA_MULTIPATH];
+				if (direct != (pass == 0))
+					continue;
+
+				counts[sr->state]++;
+				if (rtnl_talk(&rth_sync, sr->n, NULL) < 0)
+					set.failed++;
+			}
+		} else {
+			for (l = set.stale.head; l; l = l->next) {
+				struct nlmsghdr *n = &l->h;
+
+				n->nlmsg_type = RTM_DELROUTE;
+				n->nlmsg_flags = NLM_F_REQUEST;
+				deleted++;
+				if (rtnl_talk(&rth_sync, n, NULL) < 0)
+					set.failed++;
+			}
+		}
+		rtnl_pipeline_end(&rth_sync);
+
+		if (rtnl_pipeline_drain(&rth_sync) < 0)
+			set.failed++;
+	}
+
+	for (i = 0; i < set.count; i++)
+		if (set.routes[i].state == SYNC_KEEP)
+			counts[SYNC_KEEP]++;
+
+	if (show_stats)
+		printf("%u added, %u changed, %u deleted, %u unchanged\n",
+		       counts[SYNC_ADD], counts[SYNC_CHANGE], deleted,
+		       counts[SYNC_KEEP]);
+
+	if (set.failed)
+		ret = -2;
+out:
+	rtnl_close(&rth_sync);
+	free(set.routes);
+	free(set.hash);
+	free_nlmsg_chain(&set.desired);
+	free_nlmsg_chain(&set.stale);
+	return ret;
+}
+
 void iproute_reset_filter(int ifindex)
 {
 	memset(&filter, 0, sizeof(filter));
@@ -2299,6 +3021,8 @@ int do_iproute(int argc, char **argv)
 		return iproute_list_flush_or_save(argc-1, argv+1, IPROUTE_SAVE);
 	if (matches(*argv, "restore") == 0)
 		return iproute_restore();
+	if (matches(*argv, "sync") == 0)
+		return iproute_sync(argc-1, argv+1);
 	if (matches(*argv, "showdump") == 0)
 		return iproute_showdump();
 	if (matches(*argv, "help") == 0)
@@ -16,18 +16,29 @@
 #include "json_print.h"
 
 static json_writer_t *_jw;
+static int _jw_nest;	/* new_json_obj() calls inside an open one */
 
 #define _IS_JSON_CONTEXT(type) ((type & PRINT_JSON || type & PRINT_ANY) && _jw)
 #define _IS_FP_CONTEXT(type) (!_jw && (type & PRINT_FP || type & PRINT_ANY))
 
 void new_json_obj(int json)
 {
+	if (_jw) {
+		_jw_nest++;
+		return;
+	}
 	if (json) {
 		_jw = jsonw_new(stdout);
 		if (!_jw) {
 			perror("json object");
 			exit(1);
 		}
+		if (cbor)
+			jsonw_cbor(_jw, true);
+		if (json_lines) {
+			jsonw_lines(_jw, true);
+			return;
+		}
 		if (pretty)
 			jsonw_pretty(_jw, true);
 		jsonw_start_array(_jw);
@@ -36,12 +47,34 @@ void new_json_obj(int json)
 
 void delete_json_obj(void)
 {
+	if (_jw_nest) {
+		_jw_nest--;
+		return;
+	}
 	if (_jw) {
-		jsonw_end_array(_jw);
+		if (!json_lines)
+			jsonw_end_array(_jw);
 		jsonw_destroy(&_jw);
 	}
 }
 
+/* Pass on what the JSON writer holds back, for when nothing else is
+ * going to come for a while
+ */
+void fflush_fp(void)
+{
+	if (_jw)
+		jsonw_flush(_jw);
+	else
+		fflush(stdout);
+}
+
+void tag_json_obj(jsonw_tag_fn *fn, void *arg)
+{
+	if (_jw)
+		jsonw_tag(_jw, fn, arg);
+}
+
 bool is_json_context(void)
 {
 	return _jw != NULL;
@@ -15,78 +15,282 @@
 #include <malloc.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
 
 #include "json_writer.h"
 
+#define JSONW_BUFSIZ	16384
+#define JSONW_NOREC	(~0U)
+
+/* CBOR (RFC 8949) initial bytes */
+#define CBOR_UINT	0x00
+#define CBOR_NEGINT	0x20
+#define CBOR_TEXT	0x60
+#define CBOR_ARRAY	0x9f	/* indefinite length */
+#define CBOR_MAP	0xbf	/* indefinite length */
+#define CBOR_FALSE	0xf4
+#define CBOR_TRUE	0xf5
+#define CBOR_NULL	0xf6
+#define CBOR_FLOAT32	0xfa
+#define CBOR_FLOAT64	0xfb
+#define CBOR_BREAK	0xff
+
 struct json_writer {
 	FILE		*out;	/* output file */
 	unsigned	depth;  /* nesting */
 	bool		pretty; /* optional whitepace */
+	bool		lines;	/* one record per line */
+	bool		cbor;	/* binary CBOR instead of JSON text */
 	char		sep;	/* either nul or comma */
+	unsigned	rec;	/* start of the current record in buf */
+	jsonw_tag_fn	*tag;	/* adds fields to the next record */
+	void		*tag_arg;
+	unsigned	tag_depth; /* depth of the records it applies to */
+	unsigned	len;	/* bytes pending in buf */
+	char		buf[JSONW_BUFSIZ];
 };
 
+/* Hand the pending output over to the stream */
+static void jsonw_spill(json_writer_t *self)
+{
+	if (self->len) {
+		fwrite(self->buf, 1, self->len, self->out);
+		self->len = 0;
+	}
+	self->rec = JSONW_NOREC;
+}
+
+static void jsonw_write(json_writer_t *self, const char *str, size_t len)
+{
+	if (self->len + len > sizeof(self->buf)) {
+		jsonw_spill(self);
+		if (len > sizeof(self->buf)) {
+			fwrite(str, 1, len, self->out);
+			return;
+		}
+	}
+	memcpy(self->buf + self->len, str, len);
+	self->len += len;
+}
+
+static void jsonw_putc(json_writer_t *self, char c)
+{
+	if (self->len == sizeof(self->buf))
+		jsonw_spill(self);
+	self->buf[self->len++] = c;
+}
+
+static void jsonw_fputs(json_writer_t *self, const char *str)
+{
+	jsonw_write(self, str, strlen(str));
+}
+
+/* CBOR item head: major type and the shortest encoding of val */
+static void cbor_head(json_writer_t *self, unsigned char major, uint64_t val)
+{
+	unsigned char head[9];
+	int i, n;
+
+	if (val < 24) {
+		jsonw_putc(self, major | val);
+		return;
+	}
+
+	if (val <= UINT8_MAX) {
+		head[0] = major | 24;
+		n = 1;
+	} else if (val <= UINT16_MAX) {
+		head[0] = major | 25;
+		n = 2;
+	} else if (val <= UINT32_MAX) {
+		head[0] = major | 26;
+		n = 4;
+	} else {
+		head[0] = major | 27;
+		n = 8;
+	}
+	for (i = n; i > 0; i--, val >>= 8)
+		head[i] = val & 0xff;
+	jsonw_write(self, (char *)head, n + 1);
+}
+
+static void cbor_text(json_writer_t *self, const char *str, size_t len)
+{
+	cbor_head(self, CBOR_TEXT, len);
+	jsonw_write(self, str, len);
+}
+
+/* Single precision when that loses nothing, double otherwise */
+static void cbor_float(json_writer_t *self, double num)
+{
+	unsigned char out[9];
+	union { float f; uint32_t u; } f = { .f = num };
+	union { double d; uint64_t u; } d = { .d = num };
+	uint64_t bits;
+	int i, n;
+
+	if ((double)f.f == num || num != num) {
+		out[0] = CBOR_FLOAT32;
+		bits = f.u;
+		n = 4;
+	} else {
+		out[0] = CBOR_FLOAT64;
+		bits = d.u;
+		n = 8;
+	}
+	for (i = n; i > 0; i--, bits >>= 8)
+		out[i] = bits & 0xff;
+	jsonw_write(self, (char *)out, n + 1);
+}
+
+/* Turn a JSON token made by jsonw_printf() into the matching CBOR item */
+static void cbor_token(json_writer_t *self, const char *tok, size_t len)
+{
+	char *end;
+
+	if (len && tok[0] != '-' && tok[0] >= '0' && tok[0] <= '9') {
+		uint64_t u = strtoull(tok, &end, 10);
+
+		if (*end == '\0') {
+			cbor_head(self, CBOR_UINT, u);
+			return;
+		}
+	} else if (len > 1 && tok[0] == '-') {
+		int64_t s = strtoll(tok, &end, 10);
+
+		if (*end == '\0' && s < 0) {
+			cbor_head(self, CBOR_NEGINT, -(s + 1));
+			return;
+		}
+	}
+
+	if (len) {
+		double num = strtod(tok, &end);
+
+		if (*end == '\0') {
+			cbor_float(self, num);
+			return;
+		}
+	}
+
+	if (!strcmp(tok, "true"))
+		jsonw_putc(self, CBOR_TRUE);
+	else if (!strcmp(tok, "false"))
+		jsonw_putc(self, CBOR_FALSE);
+	else if (!strcmp(tok, "null"))
+		jsonw_putc(self, CBOR_NULL);
+	else if (len > 1 && tok[0] == '"' && tok[len - 1] == '"')
+		cbor_text(self, tok + 1, len - 2);
+	else
+		cbor_text(self, tok, len);
+}
+
 /* indentation for pretty print */
 static void jsonw_indent(json_writer_t *self)
 {
 	unsigned i;
 	for (i = 0; i < self->depth; ++i)
-		fputs("    ", self->out);
+		jsonw_write(self, "    ", 4);
 }
 
 /* end current line and indent if pretty printing */
 static void jsonw_eol(json_writer_t *self)
 {
-	if (!self->pretty)
+	if (!self->pretty || self->cbor)
 		return;
 
-	putc('\n', self->out);
+	jsonw_putc(self, '\n');
 	jsonw_indent(self);
 }
 
 /* If current object is not empty print a comma */
 static void jsonw_eor(json_writer_t *self)
 {
-	if (self->sep != '\0')
-		putc(self->sep, self->out);
+	if (self->sep != '\0' && !self->cbor &&
+	    !(self->lines && self->depth == 0))
+		jsonw_putc(self, self->sep);
 	self->sep = ',';
 }
 
+/* Escape for each character: 0 if it goes out as is, 'u' for \u00XX */
+static const char jsonw_escape[256] = {
+	[0 ... 0x1f] = 'u',
+	['\b'] = 'b',
+	['\t'] = 't',
+	['\n'] = 'n',
+	['\f'] = 'f',
+	['\r'] = 'r',
+	['"'] = '"',
+	['\\'] = '\\',
+};
 
 /* Output JSON encoded string */
 /* Handles C escapes, does not do Unicode */
 static void jsonw_puts(json_writer_t *self, const char *str)
 {
-	putc('"', self->out);
-	for (; *str; ++str)
-		switch (*str) {
-		case '\t':
-			fputs("\\t", self->out);
-			break;
-		case '\n':
-			fputs("\\n", self->out);
-			break;
-		case '\r':
-			fputs("\\r", self->out);
-			break;
-		case '\f':
-			fputs("\\f", self->out);
-			break;
-		case '\b':
-			fputs("\\b", self->out);
-			break;
-		case '\\':
-			fputs("\\n", self->out);
-			break;
-		case '"':
-			fputs("\\\"", self->out);
-			break;
-		case '\'':
-			fputs("\\\'", self->out);
-			break;
-		default:
-			putc(*str, self->out);
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *run = (const unsigned char *)str;
+	const unsigned char *p;
+
+	if (self->cbor) {
+		cbor_text(self, str, strlen(str));
+		return;
+	}
+
+	jsonw_putc(self, '"');
+	for (p = run; *p; ++p) {
+		char esc = jsonw_escape[*p];
+		char seq[6] = { '\\', esc, '0', '0' };
+
+		if (!esc)
+			continue;
+
+		jsonw_write(self, (const char *)run, p - run);
+		run = p + 1;
+
+		if (esc != 'u') {
+			jsonw_write(self, seq, 2);
+			continue;
 		}
-	putc('"', self->out);
+		seq[4] = hex[*p >> 4];
+		seq[5] = hex[*p & 0xf];
+		jsonw_write(self, seq, 6);
+	}
+	jsonw_write(self, (const char *)run, p - run);
+	jsonw_putc(self, '"');
+}
+
+/* Output an unsigned number, without going through printf */
+static void jsonw_putu(json_writer_t *self, bool neg, uint64_t num)
+{
+	char digits[21];
+	char *p = digits + sizeof(digits);
+
+	jsonw_eor(self);
+	if (self->cbor) {
+		/* CBOR keeps negative integers as -1 - n */
+		cbor_head(self, neg ? CBOR_NEGINT : CBOR_UINT, neg ? num - 1 : num);
+		return;
+	}
+
+	do {
+		*--p = '0' + num % 10;
+		num /= 10;
+	} while (num);
+
+	if (neg)
+		*--p = '-';
+
+	jsonw_write(self, p, digits + sizeof(digits) - p);
+}
+
+static void jsonw_puts64(json_writer_t *self, int64_t num)
+{
+	if (num < 0)
+		jsonw_putu(self, true, -(uint64_t)num);
+	else
+		jsonw_putu(self, false, num);
 }
 
 /* Create a new JSON stream */
@@ -97,7 +301,12 @@ json_writer_t *jsonw_new(FILE *f)
 		self->out = f;
 		self->depth = 0;
 		self->pretty = false;
+		self->lines = false;
+		self->cbor = false;
 		self->sep = '\0';
+		self->rec = JSONW_NOREC;
+		self->tag = NULL;
+		self->len = 0;
 	}
 	return self;
 }
@@ -108,7 +317,9 @@ void jsonw_destroy(json_writer_t **self_p)
 	json_writer_t *self = *self_p;
 
 	assert(self->depth == 0);
-	fputs("\n", self->out);
+	if (!self->lines && !self->cbor)
+		jsonw_putc(self, '\n');
+	jsonw_spill(self);
 	fflush(self->out);
 	free(self);
 	*self_p = NULL;
@@ -119,11 +330,40 @@ void jsonw_pretty(json_writer_t *self, bool on)
 	self->pretty = on;
 }
 
+void jsonw_lines(json_writer_t *self, bool on)
+{
+	self->lines = on;
+	if (on)
+		self->pretty = false;
+}
+
+void jsonw_cbor(json_writer_t *self, bool on)
+{
+	self->cbor = on;
+}
+
+void jsonw_tag(json_writer_t *self, jsonw_tag_fn *fn, void *arg)
+{
+	self->tag = fn;
+	self->tag_arg = arg;
+	self->tag_depth = self->depth + 1;
+}
+
+void jsonw_flush(json_writer_t *self)
+{
+	jsonw_spill(self);
+	fflush(self->out);
+}
+
 /* Basic blocks */
 static void jsonw_begin(json_writer_t *self, int c)
 {
 	jsonw_eor(self);
-	putc(c, self->out);
+	if (self->depth == 0)
+		self->rec = self->len;
+	if (self->cbor)
+		c = c == '{' ? CBOR_MAP : CBOR_ARRAY;
+	jsonw_putc(self, c);
 	++self->depth;
 	self->sep = '\0';
 }
@@ -132,11 +372,44 @@ static void jsonw_end(json_writer_t *self, int c)
 {
 	assert(self->depth > 0);
 
+	if (self->tag && self->depth == self->tag_depth &&
+	    self->sep != '\0' && c == '}') {
+		jsonw_tag_fn *tag = self->tag;
+		unsigned depth = self->tag_depth;
+
+		self->tag = NULL;
+		tag(self->tag_arg);
+		/* a tag renewed from fn stays with the same records */
+		self->tag_depth = depth;
+	}
+
 	--self->depth;
+	if (self->cbor)
+		c = CBOR_BREAK;
+	if (self->lines && self->depth == 0) {
+		/* records that came out empty are left out altogether */
+		if (self->sep == '\0' && self->rec != JSONW_NOREC) {
+			self->len = self->rec;
+		} else {
+			jsonw_putc(self, c);
+			if (!self->cbor)
+				jsonw_putc(self, '\n');
+		}
+		self->rec = JSONW_NOREC;
+		self->sep = '\0';
+		return;
+	}
+
 	if (self->sep != '\0')
 		jsonw_eol(self);
-	putc(c, self->out);
+	jsonw_putc(self, c);
 	self->sep = ',';
+
+	/* pass on whole records, so that the stream stays usable for
+	 * anybody else writing to it or flushing it
+	 */
+	if (self->depth <= 1 && !self->lines)
+		jsonw_spill(self);
 }
 
 
@@ -147,19 +420,60 @@ void jsonw_name(json_writer_t *self, const char *name)
 	jsonw_eol(self);
 	self->sep = '\0';
 	jsonw_puts(self, name);
-	putc(':', self->out);
+	if (self->cbor)
+		return;
+	jsonw_putc(self, ':');
 	if (self->pretty)
-		putc(' ', self->out);
+		jsonw_putc(self, ' ');
 }
 
 __attribute__((format(printf, 2, 3)))
 void jsonw_printf(json_writer_t *self, const char *fmt, ...)
 {
+	size_t room = sizeof(self->buf) - self->len;
 	va_list ap;
+	int len;
 
-	va_start(ap, fmt);
 	jsonw_eor(self);
-	vfprintf(self->out, fmt, ap);
+
+	if (self->cbor) {
+		char tok[64], *str = tok;
+
+		va_start(ap, fmt);
+		len = vsnprintf(tok, sizeof(tok), fmt, ap);
+		va_end(ap);
+		if (len >= (int)sizeof(tok)) {
+			str = malloc(len + 1);
+			if (!str)
+				return;
+			va_start(ap, fmt);
+			vsnprintf(str, len + 1, fmt, ap);
+			va_end(ap);
+		}
+		if (len < 0)
+			return;
+		cbor_token(self, str, len);
+		if (str != tok)
+			free(str);
+		return;
+	}
+
+	va_start(ap, fmt);
+	len = vsnprintf(self->buf + self->len, room, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if (len < room) {
+		self->len += len;
+		return;
+	}
+
+	jsonw_spill(self);
+	va_start(ap, fmt);
+	if (len < sizeof(self->buf))
+		self->len = vsnprintf(self->buf, sizeof(self->buf), fmt, ap);
+	else
+		vfprintf(self->out, fmt, ap);
 	va_end(ap);
 }
 
@@ -177,14 +491,14 @@ void jsonw_end_object(json_writer_t *self)
 void jsonw_start_array(json_writer_t *self)
 {
 	jsonw_begin(self, '[');
-	if (self->pretty)
-		putc(' ', self->out);
+	if (self->pretty && !self->cbor)
+		jsonw_putc(self, ' ');
 }
 
 void jsonw_end_array(json_writer_t *self)
 {
-	if (self->pretty && self->sep)
-		putc(' ', self->out);
+	if (self->pretty && self->sep && !self->cbor)
+		jsonw_putc(self, ' ');
 	self->sep = '\0';
 	jsonw_end(self, ']');
 }
@@ -198,62 +512,79 @@ void jsonw_string(json_writer_t *self, const char *value)
 
 void jsonw_bool(json_writer_t *self, bool val)
 {
-	jsonw_printf(self, "%s", val ? "true" : "false");
+	jsonw_eor(self);
+	if (self->cbor)
+		jsonw_putc(self, val ? CBOR_TRUE : CBOR_FALSE);
+	else
+		jsonw_fputs(self, val ? "true" : "false");
 }
 
 void jsonw_null(json_writer_t *self)
 {
-	jsonw_printf(self, "null");
+	jsonw_eor(self);
+	if (self->cbor)
+		jsonw_putc(self, CBOR_NULL);
+	else
+		jsonw_write(self, "null", 4);
 }
 
 void jsonw_float(json_writer_t *self, double num)
 {
+	if (self->cbor) {
+		jsonw_eor(self);
+		cbor_float(self, num);
+		return;
+	}
 	jsonw_printf(self, "%g", num);
 }
 
 void jsonw_hhu(json_writer_t *self, unsigned char num)
 {
-	jsonw_printf(self, "%hhu", num);
+	jsonw_putu(self, false, num);
 }
 
 void jsonw_hu(json_writer_t *self, unsigned short num)
 {
-	jsonw_printf(self, "%hu", num);
+	jsonw_putu(self, false, num);
 }
 
 void jsonw_uint(json_writer_t *self, unsigned int num)
 {
-	jsonw_printf(self, "%u", num);
+	jsonw_putu(self, false, num);
 }
 
 void jsonw_u64(json_writer_t *self, uint64_t num)
 {
-	jsonw_printf(self, "%"PRIu64, num);
+	jsonw_putu(self, false, num);
 }
 
 void jsonw_xint(json_writer_t *self, uint64_t num)
 {
+	if (self->cbor) {
+		jsonw_putu(self, false, num);
+		return;
+	}
 	jsonw_printf(self, "%"PRIx64, num);
 }
 
 void jsonw_luint(json_writer_t *self, unsigned long num)
 {
-	jsonw_printf(self, "%lu", num);
+	jsonw_putu(self, false, num);
 }
 
 void jsonw_lluint(json_writer_t *self, unsigned long long num)
 {
-	jsonw_printf(self, "%llu", num);
+	jsonw_putu(self, false, num);
 }
 
 void jsonw_int(json_writer_t *self, int num)
 {
-	jsonw_printf(self, "%d", num);
+	jsonw_puts64(self, num);
 }
 
 void jsonw_s64(json_writer_t *self, int64_t num)
 {
-	jsonw_printf(self, "%"PRId64, num);
+	jsonw_puts64(self, num);
 }
 
 /* Basic name/value objects */
@@ -340,9 +671,60 @@ void jsonw_null_field(json_writer_t *self, const char *prop)
 }
 
 #ifdef TEST
+#include <stdlib.h>
+#include <time.h>
+
+/* Write count route-like records to /dev/null and report the rate */
+static int bench(unsigned long count)
+{
+	FILE *out = fopen("/dev/null", "w");
+	struct timespec start, end;
+	json_writer_t *wr;
+	unsigned long i;
+	double secs;
+
+	if (!out) {
+		perror("/dev/null");
+		return 1;
+	}
+
+	wr = jsonw_new(out);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	jsonw_start_array(wr);
+	for (i = 0; i < count; i++) {
+		jsonw_start_object(wr);
+		jsonw_string_field(wr, "dst", "198.51.100.0/24");
+		jsonw_string_field(wr, "gateway", "192.0.2.1");
+		jsonw_string_field(wr, "dev", "eth0");
+		jsonw_string_field(wr, "protocol", "static");
+		jsonw_uint_field(wr, "metric", i);
+		jsonw_u64_field(wr, "bytes", i * 1500);
+		jsonw_int_field(wr, "pref", -1);
+		jsonw_name(wr, "flags");
+		jsonw_start_array(wr);
+		jsonw_string(wr, "onlink");
+		jsonw_end_array(wr);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+	jsonw_destroy(&wr);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fclose(out);
+
+	secs = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%lu records in %.3fs, %.0f records/s\n",
+	       count, secs, count / secs);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
-	json_writer_t *wr = jsonw_new(stdout);
+	json_writer_t *wr;
+
+	if (argc == 3 && strcmp(argv[1], "-bench") == 0)
+		return bench(strtoul(argv[2], NULL, 0));
+
+	wr = jsonw_new(stdout);
 
 	jsonw_start_object(wr);
 	jsonw_pretty(wr, true);
@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <time.h>
 #include <sys/uio.h>
+#include <poll.h>
 #include <linux/fib_rules.h>
 #include <linux/if_addrlabel.h>
 #include <linux/if_bridge.h>
@@ -179,6 +180,13 @@ void rtnl_close(struct rtnl_handle *rth)
 		close(rth->fd);
 		rth->fd = -1;
 	}
+
+	free(rth->rbuf);
+	rth->rbuf = NULL;
+	rth->rbuf_len = 0;
+
+	free(rth->pipe);
+	rth->pipe = NULL;
 }
 
 int rtnl_open_byproto(struct rtnl_handle *rth, unsigned int subscriptions,
@@ -314,6 +322,32 @@ int rtnl_routedump_req(struct rtnl_handle *rth, int family,
 	return send(rth->fd, &req, sizeof(req), 0);
 }
 
+int rtnl_nexthopdump_req(struct rtnl_handle *rth, int family,
+			 req_filter_fn_t filter_fn)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct nhmsg nhm;
+		char buf[128];
+	} req = {
+		.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct nhmsg)),
+		.nlh.nlmsg_type = RTM_GETNEXTHOP,
+		.nlh.nlmsg_flags = NLM_F_DUMP | NLM_F_REQUEST,
+		.nlh.nlmsg_seq = rth->dump = ++rth->seq,
+		.nhm.nh_family = family,
+	};
+
+	if (filter_fn) {
+		int err;
+
+		err = filter_fn(&req.nlh, sizeof(req));
+		if (err)
+			return err;
+	}
+
+	return send(rth->fd, &req, sizeof(req), 0);
+}
+
 int rtnl_ruledump_req(struct rtnl_handle *rth, int family)
 {
 	struct {
@@ -683,6 +717,17 @@ static void rtnl_dump_error(const struct rtnl_handle *rth,
 	}
 }
 
+/* Let the idle hook run if the next receive is going to block, this is
+ * where monitors get to pass on output they have been holding back.
+ */
+static void rtnl_idle(struct rtnl_handle *rth)
+{
+	struct pollfd pfd = { .fd = rth->fd, .events = POLLIN };
+
+	if (rth->idle && poll(&pfd, 1, 0) == 0)
+		rth->idle();
+}
+
 static int __rtnl_recvmsg(int fd, struct msghdr *msg, int flags)
 {
 	int len;
@@ -705,42 +750,151 @@ static int __rtnl_recvmsg(int fd, struct msghdr *msg, int flags)
 	return len;
 }
 
-static int rtnl_recvmsg(int fd, struct msghdr *msg, char **answer)
+/* Initial receive arena size, large enough for a kernel dump skb */
+#define RTNL_RBUF_MIN	32768
+
+static int rtnl_rbuf_grow(struct rtnl_handle *rth, size_t len)
+{
+	char *buf;
+
+	if (len < RTNL_RBUF_MIN)
+		len = RTNL_RBUF_MIN;
+	if (len <= rth->rbuf_len)
+		return 0;
+
+	buf = realloc(rth->rbuf, len);
+	if (!buf) {
+		fprintf(stderr, "malloc error: not enough buffer\n");
+		return -ENOMEM;
+	}
+
+	rth->rbuf = buf;
+	rth->rbuf_len = len;
+	return 0;
+}
+
+/* Receive one datagram into the handle's arena.  The returned buffer
+ * stays owned by the handle and is only valid until the next read on it,
+ * including the one of an rtnl_talk() from inside a dump filter.
+ * With @probe the datagram is peeked at first with MSG_TRUNC, which
+ * reports its real length, so that the arena can be grown before it is
+ * taken off the socket; when it fitted, it is then dropped without
+ * copying it again.  Without it the datagram is read straight into the
+ * arena, which is left to the caller's MSG_TRUNC check if it was too
+ * small, and only grown for the reads that follow.
+ */
+static int rtnl_recvmsg(struct rtnl_handle *rth, struct msghdr *msg,
+			char **buf, bool probe)
 {
 	struct iovec *iov = msg->msg_iov;
+	int len, err;
+
+	err = rtnl_rbuf_grow(rth, RTNL_RBUF_MIN);
+	if (err)
+		return err;
+
+	iov->iov_base = rth->rbuf;
+	iov->iov_len = rth->rbuf_len;
+
+	rtnl_idle(rth);
+	if (probe) {
+		len = __rtnl_recvmsg(rth->fd, msg, MSG_PEEK | MSG_TRUNC);
+		if (len < 0)
+			return len;
+		rth->dump_stats.recv_calls++;
+
+		if (len > rth->rbuf_len) {
+			err = rtnl_rbuf_grow(rth, len);
+			if (err)
+				return err;
+			iov->iov_base = rth->rbuf;
+			iov->iov_len = rth->rbuf_len;
+		} else {
+			iov->iov_len = 0;
+		}
+	}
+
+	len = __rtnl_recvmsg(rth->fd, msg, MSG_TRUNC);
+	if (len < 0)
+		return len;
+	rth->dump_stats.recv_calls++;
+
+	if (probe) {
+		msg->msg_flags &= ~MSG_TRUNC;
+	} else if (len > rth->rbuf_len) {
+		rtnl_rbuf_grow(rth, len);
+		len = iov->iov_len;
+	}
+	rth->dump_stats.recv_bytes += len;
+
+	*buf = rth->rbuf;
+	return len;
+}
+
+/* Same as rtnl_recvmsg(), but hands out a private copy for callers
+ * which keep the answer past the next read.
+ */
+static int rtnl_recvmsg_dup(struct rtnl_handle *rth, struct msghdr *msg,
+			    char **answer)
+{
 	char *buf;
 	int len;
 
-	iov->iov_base = NULL;
-	iov->iov_len = 0;
-
-	len = __rtnl_recvmsg(fd, msg, MSG_PEEK | MSG_TRUNC);
+	len = rtnl_recvmsg(rth, msg, &buf, true);
 	if (len < 0)
 		return len;
 
-	if (len < 32768)
-		len = 32768;
-	buf = malloc(len);
-	if (!buf) {
+	*answer = malloc(len);
+	if (!*answer) {
 		fprintf(stderr, "malloc error: not enough buffer\n");
 		return -ENOMEM;
 	}
+	memcpy(*answer, buf, len);
 
-	iov->iov_base = buf;
-	iov->iov_len = len;
+	return len;
+}
 
-	len = __rtnl_recvmsg(fd, msg, 0);
-	if (len < 0) {
-		free(buf);
-		return len;
+void rtnl_dump_stats_print(const struct rtnl_handle *rth, FILE *fp)
+{
+	const struct rtnl_dump_stats *st = &rth->dump_stats;
+
+	fprintf(fp, "netlink dump: %llu recvmsg, %llu bytes, %llu messages, %zu byte arena\n",
+		(unsigned long long)st->recv_calls,
+		(unsigned long long)st->recv_bytes,
+		(unsigned long long)st->recv_msgs,
+		rth->rbuf_len);
+}
+
+/* Let the prefetch hook see a whole batch of replies before any of them
+ * get printed, so that it can start slow work on them in the background
+ */
+static void rtnl_dump_prefetch(struct rtnl_handle *rth,
+			       const char *buf, int len)
+{
+	const struct nlmsghdr *h = (const struct nlmsghdr *)buf;
+
+	for (; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+		if (h->nlmsg_pid == rth->local.nl_pid &&
+		    h->nlmsg_seq == rth->dump &&
+		    h->nlmsg_type >= NLMSG_MIN_TYPE)
+			rth->prefetch(h);
 	}
+}
 
-	if (answer)
-		*answer = buf;
-	else
-		free(buf);
+/* Dump skbs are capped at 32K by the kernel, except for link dumps,
+ * which are grown to fit the largest link.  So once the first datagram
+ * of a dump shows it is neither, the rest of it is read without peeking.
+ */
+static bool rtnl_dump_probe(const struct rtnl_handle *rth,
+			    const char *buf, int len)
+{
+	const struct nlmsghdr *h = (const struct nlmsghdr *)buf;
 
-	return len;
+	if (len > RTNL_RBUF_MIN)
+		return true;
+
+	return rth->proto == NETLINK_ROUTE && NLMSG_OK(h, len) &&
+	       h->nlmsg_type == RTM_NEWLINK;
 }
 
 static int rtnl_dump_filter_l(struct rtnl_handle *rth,
@@ -756,6 +910,12 @@ static int rtnl_dump_filter_l(struct rtnl_handle *rth,
 	};
 	char *buf;
 	int dump_intr = 0;
+	bool probe = true, first = true;
+
+	if (rth->pipe && rtnl_pipeline_drain(rth) < 0)
+		return -1;
+
+	memset(&rth->dump_stats, 0, sizeof(rth->dump_stats));
 
 	while (1) {
 		int status;
@@ -763,12 +923,17 @@ static int rtnl_dump_filter_l(struct rtnl_handle *rth,
 		int found_done = 0;
 		int msglen = 0;
 
-		status = rtnl_recvmsg(rth->fd, &msg, &buf);
+		status = rtnl_recvmsg(rth, &msg, &buf, probe);
 		if (status < 0)
 			return status;
+		if (first)
+			probe = rtnl_dump_probe(rth, buf, status);
+		first = false;
 
 		if (rth->dump_fp)
 			fwrite(buf, 1, NLMSG_ALIGN(status), rth->dump_fp);
+		else if (rth->prefetch)
+			rtnl_dump_prefetch(rth, buf, status);
 
 		for (a = arg; a->filter; a++) {
 			struct nlmsghdr *h = (struct nlmsghdr *)buf;
@@ -788,12 +953,13 @@ static int rtnl_dump_filter_l(struct rtnl_handle *rth,
 				if (h->nlmsg_flags & NLM_F_DUMP_INTR)
 					dump_intr = 1;
 
+				if (a == arg)
+					rth->dump_stats.recv_msgs++;
+
 				if (h->nlmsg_type == NLMSG_DONE) {
 					err = rtnl_dump_done(h);
-					if (err < 0) {
-						free(buf);
+					if (err < 0)
 						return -1;
-					}
 
 					found_done = 1;
 					break; /* process next filter */
@@ -801,28 +967,26 @@ static int rtnl_dump_filter_l(struct rtnl_handle *rth,
 
 				if (h->nlmsg_type == NLMSG_ERROR) {
 					rtnl_dump_error(rth, h);
-					free(buf);
 					return -1;
 				}
 
 				if (!rth->dump_fp) {
 					err = a->filter(h, a->arg1);
-					if (err < 0) {
-						free(buf);
+					if (err < 0)
 						return err;
-					}
 				}
 
 skip_it:
 				h = NLMSG_NEXT(h, msglen);
 			}
 		}
-		free(buf);
 
 		if (found_done) {
 			if (dump_intr)
 				fprintf(stderr,
 					"Dump was interrupted and may be inconsistent.\n");
+			if (rth->flags & RTNL_HANDLE_F_DUMP_STATS)
+				rtnl_dump_stats_print(rth, stderr);
 			return 0;
 		}
 
@@ -860,9 +1024,230 @@ static void rtnl_talk_error(struct nlmsghdr *h, struct nlmsgerr *err,
 }
 
 
+struct rtnl_pending {
+	__u32			seq;
+	int			tag;
+	bool			show_err;
+};
+
+/* Requests sent with NLM_F_ACK whose ACK has not been read yet */
+struct rtnl_pipeline {
+	rtnl_ack_fn_t		fn;
+	void			*arg;
+	int			tag;
+	unsigned int		window;
+	unsigned int		head;
+	unsigned int		count;
+	struct rtnl_pending	ring[];
+};
+
+int rtnl_pipeline_init(struct rtnl_handle *rth, unsigned int window,
+		       rtnl_ack_fn_t fn, void *arg)
+{
+	struct rtnl_pipeline *pipe;
+
+	if (!window)
+		window = 1;
+
+	pipe = calloc(1, sizeof(*pipe) + window * sizeof(pipe->ring[0]));
+	if (!pipe) {
+		fprintf(stderr, "malloc error: not enough buffer\n");
+		return -1;
+	}
+
+	pipe->fn = fn;
+	pipe->arg = arg;
+	pipe->window = window;
+
+	rtnl_pipeline_drain(rth);
+	free(rth->pipe);
+	rth->pipe = pipe;
+	return 0;
+}
+
+/* Until rtnl_pipeline_end(), rtnl_talk() requests without an answer are
+ * sent without waiting for their ACK; the ACK is reported to the
+ * pipeline callback together with @tag.
+ */
+void rtnl_pipeline_begin(struct rtnl_handle *rth, int tag)
+{
+	if (!rth->pipe)
+		return;
+
+	rth->pipe->tag = tag;
+	rth->flags |= RTNL_HANDLE_F_PIPELINE;
+}
+
+void rtnl_pipeline_end(struct rtnl_handle *rth)
+{
+	rth->flags &= ~RTNL_HANDLE_F_PIPELINE;
+}
+
+static void rtnl_pipeline_abort(struct rtnl_handle *rth, int error)
+{
+	struct rtnl_pipeline *pipe = rth->pipe;
+
+	while (pipe->count) {
+		struct rtnl_pending *p = &pipe->ring[pipe->head];
+
+		pipe->head = (pipe->head + 1) % pipe->window;
+		pipe->count--;
+		if (pipe->fn)
+			pipe->fn(p->tag, error, NULL, pipe->arg);
+	}
+}
+
+/* Read one datagram and retire the requests it acknowledges.
+ * Returns the number of failed requests or a negative receive error.
+ */
+static int rtnl_pipeline_recv(struct rtnl_handle *rth)
+{
+	struct rtnl_pipeline *pipe = rth->pipe;
+	struct sockaddr_nl nladdr;
+	struct iovec iov;
+	struct msghdr msg = {
+		.msg_name = &nladdr,
+		.msg_namelen = sizeof(nladdr),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+	struct nlmsghdr *h;
+	int status, failed = 0;
+	char *buf;
+
+	status = rtnl_recvmsg(rth, &msg, &buf, false);
+	if (status < 0)
+		return status;
+
+	if (msg.msg_flags & MSG_TRUNC) {
+		fprintf(stderr, "Message truncated\n");
+		return -EMSGSIZE;
+	}
+
+	for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, status);
+	     h = NLMSG_NEXT(h, status)) {
+		struct rtnl_pending *p = &pipe->ring[pipe->head];
+		struct nlmsgerr *err = NLMSG_DATA(h);
+		int error;
+
+		if (!pipe->count || nladdr.nl_pid != 0 ||
+		    h->nlmsg_pid != rth->local.nl_pid ||
+		    h->nlmsg_seq != p->seq)
+			continue;
+
+		if (h->nlmsg_type != NLMSG_ERROR) {
+			if (pipe->fn)
+				pipe->fn(p->tag, 0, h, pipe->arg);
+			continue;
+		}
+
+		if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
+			fprintf(stderr, "ERROR truncated\n");
+			error = -EINVAL;
+		} else {
+			error = err->error;
+			if (!error)
+				nl_dump_ext_ack(h, NULL);
+			else if (rth->proto != NETLINK_SOCK_DIAG &&
+				 !(rth->flags & RTNL_HANDLE_F_SUPPRESS_NLERR) &&
+				 p->show_err)
+				rtnl_talk_error(h, err, NULL);
+		}
+
+		pipe->head = (pipe->head + 1) % pipe->window;
+		pipe->count--;
+		if (error)
+			failed++;
+		if (pipe->fn)
+			pipe->fn(p->tag, error, h, pipe->arg);
+	}
+
+	return failed;
+}
+
+/* Wait for all outstanding ACKs.  Returns the number of requests which
+ * failed, or a negative value if the ACKs could not be read.
+ */
+int rtnl_pipeline_drain(struct rtnl_handle *rth)
+{
+	struct rtnl_pipeline *pipe = rth->pipe;
+	int failed = 0;
+
+	if (!pipe)
+		return 0;
+
+	while (pipe->count) {
+		int ret = rtnl_pipeline_recv(rth);
+
+		if (ret < 0) {
+			rtnl_pipeline_abort(rth, ret);
+			return ret;
+		}
+		failed += ret;
+	}
+
+	return failed;
+}
+
+/* Drain the pipeline and go back to waiting for each ACK in rtnl_talk() */
+int rtnl_pipeline_destroy(struct rtnl_handle *rth)
+{
+	int ret = rtnl_pipeline_drain(rth);
+
+	free(rth->pipe);
+	rth->pipe = NULL;
+	return ret;
+}
+
+static int rtnl_pipeline_send(struct rtnl_handle *rtnl, struct iovec *iov,
+			      size_t iovlen, bool show_rtnl_err)
+{
+	struct rtnl_pipeline *pipe = rtnl->pipe;
+	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+	struct msghdr msg = {
+		.msg_name = &nladdr,
+		.msg_namelen = sizeof(nladdr),
+		.msg_iov = iov,
+		.msg_iovlen = iovlen,
+	};
+	unsigned int slot;
+	int i, status;
+
+	/* make room in the window, failures go to the callback */
+	while (pipe->count + iovlen > pipe->window) {
+		status = rtnl_pipeline_recv(rtnl);
+		if (status < 0) {
+			rtnl_pipeline_abort(rtnl, status);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < iovlen; i++) {
+		struct nlmsghdr *h = iov[i].iov_base;
+
+		h->nlmsg_seq = ++rtnl->seq;
+		h->nlmsg_flags |= NLM_F_ACK;
+
+		slot = (pipe->head + pipe->count + i) % pipe->window;
+		pipe->ring[slot].seq = h->nlmsg_seq;
+		pipe->ring[slot].tag = pipe->tag;
+		pipe->ring[slot].show_err = show_rtnl_err;
+	}
+
+	status = sendmsg(rtnl->fd, &msg, 0);
+	if (status < 0) {
+		perror("Cannot talk to rtnetlink");
+		return -1;
+	}
+
+	pipe->count += iovlen;
+	return 0;
+}
+
 static int __rtnl_talk_iov(struct rtnl_handle *rtnl, struct iovec *iov,
 			   size_t iovlen, struct nlmsghdr **answer,
-			   bool show_rtnl_err, nl_ext_ack_fn_t errfn)
+			   bool show_rtnl_err, nl_ext_ack_fn_t errfn,
+			   rtnl_ack_fn_t ackfn, void *arg)
 {
 	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
 	struct iovec riov;
@@ -875,8 +1260,21 @@ static int __rtnl_talk_iov(struct rtnl_handle *rtnl, struct iovec *iov,
 	unsigned int seq = 0;
 	struct nlmsghdr *h;
 	int i, status;
+	int failed = 0;
 	char *buf;
 
+	if (rtnl->pipe) {
+		if (!answer && !ackfn &&
+		    (rtnl->flags & RTNL_HANDLE_F_PIPELINE) &&
+		    iovlen <= rtnl->pipe->window)
+			return rtnl_pipeline_send(rtnl, iov, iovlen,
+						  show_rtnl_err);
+
+		/* don't let a synchronous request overtake queued ones */
+		if (rtnl_pipeline_drain(rtnl) < 0)
+			return -1;
+	}
+
 	for (i = 0; i < iovlen; i++) {
 		h = iov[i].iov_base;
 		h->nlmsg_seq = seq = ++rtnl->seq;
@@ -896,7 +1294,7 @@ static int __rtnl_talk_iov(struct rtnl_handle *rtnl, struct iovec *iov,
 	i = 0;
 	while (1) {
 next:
-		status = rtnl_recvmsg(rtnl->fd, &msg, &buf);
+		status = rtnl_recvmsg_dup(rtnl, &msg, &buf);
 		++i;
 
 		if (status < 0)
@@ -959,9 +1357,15 @@ next:
 				else
 					free(buf);
 
+				if (ackfn)
+					ackfn(i, error, h, arg);
+
+				/* report the first message that failed */
+				if (error && !failed)
+					failed = i;
 				if (i < iovlen)
 					goto next;
-				return error ? -i : 0;
+				return failed ? -failed : 0;
 			}
 
 			if (answer) {
@@ -997,7 +1401,8 @@ static int __rtnl_talk(struct rtnl_handle *rtnl, struct nlmsghdr *n,
 		.iov_len = n->nlmsg_len
 	};
 
-	return __rtnl_talk_iov(rtnl, &iov, 1, answer, show_rtnl_err, errfn);
+	return __rtnl_talk_iov(rtnl, &iov, 1, answer, show_rtnl_err, errfn,
+			       NULL, NULL);
 }
 
 int rtnl_talk(struct rtnl_handle *rtnl, struct nlmsghdr *n,
@@ -1009,7 +1414,18 @@ int rtnl_talk(struct rtnl_handle *rtnl, struct nlmsghdr *n,
 int rtnl_talk_iov(struct rtnl_handle *rtnl, struct iovec *iovec, size_t iovlen,
 		  struct nlmsghdr **answer)
 {
-	return __rtnl_talk_iov(rtnl, iovec, iovlen, answer, true, NULL);
+	return __rtnl_talk_iov(rtnl, iovec, iovlen, answer, true, NULL,
+			       NULL, NULL);
+}
+
+/* Like rtnl_talk_iov() without answers, fn() sees the ACK of every
+ * message with its position in iovec (from 1) as tag.
+ */
+int rtnl_talk_iov_ack(struct rtnl_handle *rtnl, struct iovec *iovec,
+		      size_t iovlen, rtnl_ack_fn_t fn, void *arg)
+{
+	return __rtnl_talk_iov(rtnl, iovec, iovlen, NULL, true, NULL,
+			       fn, arg);
 }
 
 int rtnl_talk_suppress_rtnl_errmsg(struct rtnl_handle *rtnl, struct nlmsghdr *n,
@@ -1031,6 +1447,13 @@ int rtnl_listen_all_nsid(struct rtnl_handle *rth)
 	return 0;
 }
 
+/* Groups past 31 do not fit the bind() mask of rtnl_open() */
+int rtnl_add_nl_group(struct rtnl_handle *rth, unsigned int group)
+{
+	return setsockopt(rth->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+			  &group, sizeof(group));
+}
+
 int rtnl_listen(struct rtnl_handle *rtnl,
 		rtnl_listen_filter_t handler,
 		void *jarg)
@@ -1059,6 +1482,7 @@ int rtnl_listen(struct rtnl_handle *rtnl,
 		struct cmsghdr *cmsg;
 
 		iov.iov_len = sizeof(buf);
+		rtnl_idle(rtnl);
 		status = recvmsg(rtnl->fd, &msg, 0);
 
 		if (status < 0) {
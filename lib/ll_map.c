@@ -17,11 +17,13 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <string.h>
+#include <errno.h>
 #include <net/if.h>
 
 #include "libnetlink.h"
 #include "ll_map.h"
 #include "list.h"
+#include "utils.h"
 
 struct ll_cache {
 	struct hlist_node idx_hash;
@@ -29,17 +31,38 @@ struct ll_cache {
 	unsigned	flags;
 	unsigned 	index;
 	unsigned short	type;
-	char		name[];
+	char		name[IFNAMSIZ];
 };
 
-#define IDXMAP_SIZE	1024
-static struct hlist_head idx_head[IDXMAP_SIZE];
-static struct hlist_head name_head[IDXMAP_SIZE];
+/* Both hashes double in size whenever they hold more links than buckets */
+#define IDXMAP_MIN	1024
+static struct hlist_head *idx_head;
+static struct hlist_head *name_head;
+static unsigned int idxmap_size;
+static unsigned int idxmap_count;
+
+static int ll_initialized;
+
+/* Names handed out must outlive the links they belong to, at least up
+ * to the next command: deleted entries are parked here, on their index
+ * hash node, and freed by ll_init_map().
+ */
+static struct hlist_head ll_dead;
+
+/* In watch mode, link events from this socket are applied to the cache
+ * before every lookup, so that it is complete and never goes stale.
+ */
+static struct rtnl_handle ll_watch_rth = { .fd = -1 };
+
+static void ll_watch_drain(void);
 
 static struct ll_cache *ll_get_by_index(unsigned index)
 {
 	struct hlist_node *n;
-	unsigned h = index & (IDXMAP_SIZE - 1);
+	unsigned h = index & (idxmap_size - 1);
+
+	if (!idxmap_size)
+		return NULL;
 
 	hlist_for_each(n, &idx_head[h]) {
 		struct ll_cache *im
@@ -64,7 +87,10 @@ unsigned namehash(const char *str)
 static struct ll_cache *ll_get_by_name(const char *name)
 {
 	struct hlist_node *n;
-	unsigned h = namehash(name) & (IDXMAP_SIZE - 1);
+	unsigned h = namehash(name) & (idxmap_size - 1);
+
+	if (!idxmap_size)
+		return NULL;
 
 	hlist_for_each(n, &name_head[h]) {
 		struct ll_cache *im
@@ -77,13 +103,82 @@ static struct ll_cache *ll_get_by_name(const char *name)
 	return NULL;
 }
 
+static int ll_hash_grow(void)
+{
+	unsigned int size = idxmap_size ? idxmap_size * 2 : IDXMAP_MIN;
+	struct hlist_head *idx, *name;
+	unsigned int i;
+
+	idx = calloc(size, sizeof(*idx));
+	name = calloc(size, sizeof(*name));
+	if (!idx || !name) {
+		free(idx);
+		free(name);
+		return -1;
+	}
+
+	for (i = 0; i < idxmap_size; i++) {
+		struct hlist_node *n, *tmp;
+
+		hlist_for_each_safe(n, tmp, &idx_head[i]) {
+			struct ll_cache *im
+				= container_of(n, struct ll_cache, idx_hash);
+
+			hlist_add_head(&im->idx_hash,
+				       &idx[im->index & (size - 1)]);
+			hlist_add_head(&im->name_hash,
+				       &name[namehash(im->name) & (size - 1)]);
+		}
+	}
+
+	free(idx_head);
+	free(name_head);
+	idx_head = idx;
+	name_head = name;
+	idxmap_size = size;
+	return 0;
+}
+
+static void ll_cache_del(struct ll_cache *im)
+{
+	hlist_del(&im->idx_hash);
+	hlist_del(&im->name_hash);
+	idxmap_count--;
+	hlist_add_head(&im->idx_hash, &ll_dead);
+}
+
+static void ll_free_dead(void)
+{
+	struct hlist_node *n, *tmp;
+
+	hlist_for_each_safe(n, tmp, &ll_dead) {
+		hlist_del(n);
+		free(container_of(n, struct ll_cache, idx_hash));
+	}
+}
+
+/* The name is all the cache needs from the attributes, and the kernel
+ * puts it first: no need to parse the rest.
+ */
+static const char *ll_ifname(struct nlmsghdr *n)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(n);
+	struct rtattr *rta = IFLA_RTA(ifi);
+	int len = IFLA_PAYLOAD(n);
+
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+		if (rta->rta_type == IFLA_IFNAME)
+			return rta_getattr_str(rta);
+
+	return NULL;
+}
+
 int ll_remember_index(struct nlmsghdr *n, void *arg)
 {
 	unsigned int h;
 	const char *ifname;
 	struct ifinfomsg *ifi = NLMSG_DATA(n);
 	struct ll_cache *im;
-	struct rtattr *tb[IFLA_MAX+1];
 
 	if (n->nlmsg_type != RTM_NEWLINK && n->nlmsg_type != RTM_DELLINK)
 		return 0;
@@ -93,44 +188,44 @@ int ll_remember_index(struct nlmsghdr *n, void *arg)
 
 	im = ll_get_by_index(ifi->ifi_index);
 	if (n->nlmsg_type == RTM_DELLINK) {
-		if (im) {
-			hlist_del(&im->name_hash);
-			hlist_del(&im->idx_hash);
-			free(im);
-		}
+		if (im)
+			ll_cache_del(im);
 		return 0;
 	}
 
-	parse_rtattr(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(n));
-	ifname = rta_getattr_str(tb[IFLA_IFNAME]);
+	ifname = ll_ifname(n);
 	if (ifname == NULL)
 		return 0;
 
 	if (im) {
-		/* change to existing entry */
-		if (strcmp(im->name, ifname) != 0) {
-			hlist_del(&im->name_hash);
-			h = namehash(ifname) & (IDXMAP_SIZE - 1);
-			hlist_add_head(&im->name_hash, &name_head[h]);
-		}
-
 		im->flags = ifi->ifi_flags;
+		if (strcmp(im->name, ifname) == 0)
+			return 0;
+		/* renamed in place, the old name was handed out */
+		hlist_del(&im->name_hash);
+		strlcpy(im->name, ifname, sizeof(im->name));
+		h = namehash(im->name) & (idxmap_size - 1);
+		hlist_add_head(&im->name_hash, &name_head[h]);
 		return 0;
 	}
 
-	im = malloc(sizeof(*im) + strlen(ifname) + 1);
+	if (idxmap_count >= idxmap_size && ll_hash_grow() < 0)
+		return 0;
+
+	im = malloc(sizeof(*im));
 	if (im == NULL)
 		return 0;
 	im->index = ifi->ifi_index;
-	strcpy(im->name, ifname);
+	strlcpy(im->name, ifname, sizeof(im->name));
 	im->type = ifi->ifi_type;
 	im->flags = ifi->ifi_flags;
 
-	h = ifi->ifi_index & (IDXMAP_SIZE - 1);
+	h = ifi->ifi_index & (idxmap_size - 1);
 	hlist_add_head(&im->idx_hash, &idx_head[h]);
 
-	h = namehash(ifname) & (IDXMAP_SIZE - 1);
+	h = namehash(im->name) & (idxmap_size - 1);
 	hlist_add_head(&im->name_hash, &name_head[h]);
+	idxmap_count++;
 
 	return 0;
 }
@@ -164,7 +259,7 @@ static int ll_link_get(const char *name, int index)
 		.n.nlmsg_type = RTM_GETLINK,
 		.ifm.ifi_index = index,
 	};
-	__u32 filt_mask = RTEXT_FILTER_VF | RTEXT_FILTER_SKIP_STATS;
+	__u32 filt_mask = RTEXT_FILTER_SKIP_STATS;
 	struct rtnl_handle rth = {};
 	struct nlmsghdr *answer;
 	int rc = 0;
@@ -202,10 +297,14 @@ const char *ll_index_to_name(unsigned int idx)
 	if (idx == 0)
 		return "*";
 
+	ll_watch_drain();
 	im = ll_get_by_index(idx);
 	if (im)
 		return im->name;
 
+	if (ll_watch_rth.fd >= 0)
+		return ll_idx_n2a(idx);
+
 	if (ll_link_get(NULL, idx) == idx) {
 		im = ll_get_by_index(idx);
 		if (im)
@@ -225,6 +324,7 @@ int ll_index_to_type(unsigned idx)
 	if (idx == 0)
 		return -1;
 
+	ll_watch_drain();
 	im = ll_get_by_index(idx);
 	return im ? im->type : -1;
 }
@@ -236,6 +336,7 @@ int ll_index_to_flags(unsigned idx)
 	if (idx == 0)
 		return 0;
 
+	ll_watch_drain();
 	im = ll_get_by_index(idx);
 	return im ? im->flags : -1;
 }
@@ -248,10 +349,15 @@ unsigned ll_name_to_index(const char *name)
 	if (name == NULL)
 		return 0;
 
+	ll_watch_drain();
 	im = ll_get_by_name(name);
 	if (im)
 		return im->index;
 
+	/* the cache knows every link, no point in asking the kernel */
+	if (ll_watch_rth.fd >= 0)
+		return ll_idx_a2n(name);
+
 	idx = ll_link_get(name, 0);
 	if (idx == 0)
 		idx = if_nametoindex(name);
@@ -268,28 +374,152 @@ void ll_drop_by_index(unsigned index)
 	if (!im)
 		return;
 
-	hlist_del(&im->idx_hash);
-	hlist_del(&im->name_hash);
+	ll_cache_del(im);
+}
 
-	free(im);
+static void ll_dump_links(struct rtnl_handle *rth)
+{
+	/* the cache only needs names, types and flags: leave stats and
+	 * VF information out of the dump
+	 */
+	if (rtnl_linkdump_req_filter(rth, AF_UNSPEC,
+				     RTEXT_FILTER_SKIP_STATS) < 0) {
+		perror("Cannot send dump request");
+		exit(1);
+	}
+
+	if (rtnl_dump_filter(rth, ll_remember_index, NULL) < 0) {
+		fprintf(stderr, "Dump terminated\n");
+		exit(1);
+	}
+
+	ll_initialized = 1;
 }
 
 void ll_init_map(struct rtnl_handle *rth)
 {
-	static int initialized;
+	/* a new command: nothing from the last one is in use any more */
+	ll_free_dead();
 
-	if (initialized)
+	if (ll_initialized)
 		return;
 
-	if (rtnl_linkdump_req(rth, AF_UNSPEC) < 0) {
-		perror("Cannot send dump request");
-		exit(1);
+	ll_dump_links(rth);
+}
+
+void ll_flush_map(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < idxmap_size; i++) {
+		struct hlist_node *n, *tmp;
+
+		hlist_for_each_safe(n, tmp, &idx_head[i])
+			ll_cache_del(container_of(n, struct ll_cache,
+						  idx_hash));
 	}
+	ll_initialized = 0;
+}
 
-	if (rtnl_dump_filter(rth, ll_remember_index, NULL) < 0) {
-		fprintf(stderr, "Dump terminated\n");
+/* Events were lost: start over from a fresh dump, keeping the old
+ * entries parked since this runs in the middle of a command
+ */
+static void ll_watch_resync(void)
+{
+	struct rtnl_handle rth = { .fd = -1 };
+
+	ll_flush_map();
+	if (rtnl_open(&rth, 0) < 0)
 		exit(1);
+	ll_dump_links(&rth);
+	rtnl_close(&rth);
+}
+
+/* Events are peeked at first, so that the buffer can be grown for ones
+ * bigger than it, like RTM_NEWLINK of a device with many VFs
+ */
+static void ll_watch_drain(void)
+{
+	static size_t size = 32768;
+	static char *buf;
+	int resync = 0;
+
+	if (ll_watch_rth.fd < 0)
+		return;
+
+	if (!buf) {
+		buf = malloc(size);
+		if (!buf) {
+			fprintf(stderr, "malloc error: not enough buffer\n");
+			exit(1);
+		}
 	}
 
-	initialized = 1;
+	for (;;) {
+		struct nlmsghdr *h;
+		int status;
+
+		status = recv(ll_watch_rth.fd, buf, size,
+			      MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+		if (status < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				resync = 1;
+				continue;
+			}
+			if (errno != EAGAIN)
+				perror("Link event receive error");
+			if (!resync)
+				return;
+			/* whatever is still queued predates the new dump */
+			ll_watch_resync();
+			resync = 0;
+			continue;
+		}
+
+		if (status > size) {
+			char *nbuf = realloc(buf, status);
+
+			if (!nbuf) {
+				fprintf(stderr, "malloc error: not enough buffer\n");
+				exit(1);
+			}
+			buf = nbuf;
+			size = status;
+			continue;
+		}
+		recv(ll_watch_rth.fd, NULL, 0, MSG_TRUNC | MSG_DONTWAIT);
+
+		/* queued events are stale once some were lost */
+		if (resync)
+			continue;
+
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, status);
+		     h = NLMSG_NEXT(h, status))
+			ll_remember_index(h, NULL);
+	}
+}
+
+int ll_watch_links(struct rtnl_handle *rth)
+{
+	if (ll_watch_rth.fd >= 0)
+		return 0;
+
+	/* subscribe before the dump so that no change slips in between */
+	if (rtnl_open(&ll_watch_rth, RTMGRP_LINK) < 0)
+		return -1;
+
+	ll_flush_map();
+	ll_init_map(rth);
+	ll_watch_drain();
+	return 0;
+}
+
+/* The socket only sees the namespace it was opened in: close it before
+ * switching to another one.
+ */
+void ll_watch_stop(void)
+{
+	rtnl_close(&ll_watch_rth);
 }
@@ -116,6 +116,49 @@ int netns_get_fd(const char *name)
 	return open(path, O_RDONLY);
 }
 
+/* Call func(arg) in the network namespace netns, then come back.  Unlike
+ * netns_switch(), nothing but the network namespace changes: sockets made
+ * meanwhile stay in netns for good.
+ */
+int netns_run(const char *netns, int (*func)(void *arg), void *arg)
+{
+	static int home = -1;
+	int fd, ret;
+
+	if (home < 0) {
+		home = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+		if (home < 0) {
+			fprintf(stderr, "Cannot open current network namespace: %s\n",
+				strerror(errno));
+			return -1;
+		}
+	}
+
+	fd = netns_get_fd(netns);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open network namespace \"%s\": %s\n",
+			netns, strerror(errno));
+		return -1;
+	}
+
+	if (setns(fd, CLONE_NEWNET) < 0) {
+		fprintf(stderr, "setting the network namespace \"%s\" failed: %s\n",
+			netns, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	ret = func(arg);
+
+	if (setns(home, CLONE_NEWNET) < 0) {
+		fprintf(stderr, "Cannot return to the original network namespace: %s\n",
+			strerror(errno));
+		exit(1);
+	}
+	return ret;
+}
+
 int netns_foreach(int (*func)(char *nsname, void *arg), void *arg)
 {
 	DIR *dir;
@@ -31,6 +31,8 @@
 #include <time.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <pthread.h>
+#include <linux/neighbour.h>
 #ifdef HAVE_LIBCAP
 #include <sys/capability.h>
 #endif
@@ -43,6 +45,8 @@
 int resolve_hosts;
 int timestamp_short;
 int pretty;
+int json_lines;
+int cbor;
 const char *_SL_ = "\n";
 
 static int af_byte_len(int af);
@@ -1058,22 +1062,203 @@ const char *family_name(int family)
 }
 
 #ifdef RESOLVE_HOSTNAMES
+/* Reverse lookups are done by a small pool of threads, fed ahead of time
+ * through resolve_prefetch() so that names are usually ready by the time
+ * they get printed, in order, by format_host().  Results, failures
+ * included, are kept for a while; the same address is looked up once.
+ */
+#define RESOLVE_WORKERS	16
+#define RESOLVE_TTL	300	/* seconds a name is trusted */
+#define RESOLVE_NEG_TTL	30	/* seconds a failed lookup is trusted */
+
+enum {
+	NAMEREC_QUEUED,		/* waiting for a worker */
+	NAMEREC_BUSY,		/* being looked up */
+	NAMEREC_DONE,
+};
+
 struct namerec {
 	struct namerec *next;
+	struct namerec *qnext;	/* lookup queue */
 	const char *name;
+	time_t expires;
+	int state;
+	bool queued;
 	inet_prefix addr;
 };
 
-#define NHASH 257
+#define NHASH 4093
 static struct namerec *nht[NHASH];
+static struct namerec *nq_head, **nq_tail = &nq_head;
+static int nworkers, nidle;
+static pthread_mutex_t nht_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t nht_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t nht_done = PTHREAD_COND_INITIALIZER;
+
+/* RESOLVE_HOSTS_FILE names a hosts(5) file to take the names from instead
+ * of the system resolver, so that -resolve can be tested offline.
+ */
+static struct namerec *hosts_file;
+static bool use_hosts_file;
+
+static void read_hosts_file(const char *path)
+{
+	char line[512];
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		perror(path);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *addr = strtok(line, " \t\n");
+		char *name = strtok(NULL, " \t\n");
+		struct namerec *h;
+
+		if (!addr || !name || *addr == '#')
+			continue;
+		h = calloc(1, sizeof(*h));
+		if (!h)
+			break;
+		if (get_addr_1(&h->addr, addr, AF_UNSPEC)) {
+			free(h);
+			continue;
+		}
+		h->name = strdup(name);
+		h->next = hosts_file;
+		hosts_file = h;
+	}
+	fclose(fp);
+}
+
+static const char *lookup_hosts_file(const inet_prefix *a)
+{
+	const struct namerec *h;
+
+	for (h = hosts_file; h; h = h->next) {
+		if (h->addr.family == a->family &&
+		    h->addr.bytelen == a->bytelen &&
+		    memcmp(h->addr.data, a->data, a->bytelen) == 0)
+			return h->name;
+	}
+	return NULL;
+}
+
+static char *lookup_name(const inet_prefix *a)
+{
+	struct sockaddr_storage ss = { .ss_family = a->family };
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+	char host[NI_MAXHOST];
+	socklen_t salen;
+
+	if (use_hosts_file) {
+		const char *name = lookup_hosts_file(a);
+
+		return name ? strdup(name) : NULL;
+	}
+
+	if (a->family == AF_INET) {
+		memcpy(&sin->sin_addr, a->data, 4);
+		salen = sizeof(*sin);
+	} else {
+		memcpy(&sin6->sin6_addr, a->data, 16);
+		salen = sizeof(*sin6);
+	}
+
+	if (getnameinfo((struct sockaddr *)&ss, salen, host, sizeof(host),
+			NULL, 0, NI_NAMEREQD))
+		return NULL;
+	return strdup(host);
+}
+
+static time_t resolve_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* Look n up with nht_lock held; the lock is dropped meanwhile */
+static void namerec_lookup(struct namerec *n)
+{
+	char *name;
+
+	n->state = NAMEREC_BUSY;
+	pthread_mutex_unlock(&nht_lock);
+	name = lookup_name(&n->addr);
+	pthread_mutex_lock(&nht_lock);
+
+	/* a stale name is kept until its replacement is known */
+	if (name || !n->name) {
+		free((char *)n->name);
+		n->name = name;
+	}
+	n->expires = resolve_now() + (name ? RESOLVE_TTL : RESOLVE_NEG_TTL);
+	n->state = NAMEREC_DONE;
+	pthread_cond_broadcast(&nht_done);
+}
+
+static void *resolve_worker(void *arg)
+{
+	pthread_mutex_lock(&nht_lock);
+	while (1) {
+		struct namerec *n = nq_head;
+
+		if (!n) {
+			nidle++;
+			pthread_cond_wait(&nht_work, &nht_lock);
+			nidle--;
+			continue;
+		}
+
+		nq_head = n->qnext;
+		if (!nq_head)
+			nq_tail = &nq_head;
+		n->queued = false;
+
+		/* the printer may have got to it first */
+		if (n->state == NAMEREC_QUEUED)
+			namerec_lookup(n);
+	}
+	return NULL;
+}
+
+static void namerec_queue(struct namerec *n)
+{
+	n->state = NAMEREC_QUEUED;
+	if (n->queued)
+		return;
+	n->queued = true;
+	n->qnext = NULL;
+	*nq_tail = n;
+	nq_tail = &n->qnext;
+
+	if (nidle) {
+		pthread_cond_signal(&nht_work);
+	} else if (nworkers < RESOLVE_WORKERS) {
+		pthread_attr_t attr;
+		pthread_t tid;
+
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&tid, &attr, resolve_worker, NULL) == 0)
+			nworkers++;
+		pthread_attr_destroy(&attr);
+	}
+}
 
-static const char *resolve_address(const void *addr, int len, int af)
+/* Find the entry for an address with nht_lock held, and have it looked
+ * up (again) if it is new or has expired
+ */
+static struct namerec *namerec_get(const void *addr, int len, int af)
 {
+	static bool init;
 	struct namerec *n;
-	struct hostent *h_ent;
 	unsigned int hash;
-	static int notfirst;
-
 
 	if (af == AF_INET6 && ((__u32 *)addr)[0] == 0 &&
 	    ((__u32 *)addr)[1] == 0 && ((__u32 *)addr)[2] == htonl(0xffff)) {
@@ -1082,33 +1267,141 @@ static const char *resolve_address(const void *addr, int len, int af)
 		len = 4;
 	}
 
+	if ((af != AF_INET || len != 4) && (af != AF_INET6 || len != 16))
+		return NULL;
+
+	if (!init) {
+		const char *path = getenv("RESOLVE_HOSTS_FILE");
+
+		if (path) {
+			read_hosts_file(path);
+			use_hosts_file = true;
+		}
+		init = true;
+	}
+
 	hash = *(__u32 *)(addr + len - 4) % NHASH;
 
 	for (n = nht[hash]; n; n = n->next) {
 		if (n->addr.family == af &&
 		    n->addr.bytelen == len &&
 		    memcmp(n->addr.data, addr, len) == 0)
-			return n->name;
+			break;
 	}
-	n = malloc(sizeof(*n));
-	if (n == NULL)
-		return NULL;
-	n->addr.family = af;
-	n->addr.bytelen = len;
-	n->name = NULL;
-	memcpy(n->addr.data, addr, len);
-	n->next = nht[hash];
-	nht[hash] = n;
-	if (++notfirst == 1)
-		sethostent(1);
-	fflush(stdout);
-
-	h_ent = gethostbyaddr(addr, len, af);
-	if (h_ent != NULL)
-		n->name = strdup(h_ent->h_name);
-
-	/* Even if we fail, "negative" entry is remembered. */
-	return n->name;
+
+	if (!n) {
+		n = calloc(1, sizeof(*n));
+		if (n == NULL)
+			return NULL;
+		n->addr.family = af;
+		n->addr.bytelen = len;
+		memcpy(n->addr.data, addr, len);
+		n->next = nht[hash];
+		nht[hash] = n;
+		namerec_queue(n);
+	} else if (n->state == NAMEREC_DONE && n->expires <= resolve_now()) {
+		namerec_queue(n);
+	}
+	return n;
+}
+
+void resolve_prefetch(int af, int len, const void *addr)
+{
+	if (!resolve_hosts)
+		return;
+
+	pthread_mutex_lock(&nht_lock);
+	namerec_get(addr, len, af);
+	pthread_mutex_unlock(&nht_lock);
+}
+
+/* Queue the addresses a route, address or neighbour message carries */
+void resolve_prefetch_nlmsg(const struct nlmsghdr *n)
+{
+	const struct rtattr *rta;
+	unsigned int types;
+	int family, len;
+
+	switch (n->nlmsg_type) {
+	case RTM_NEWROUTE:
+	case RTM_DELROUTE: {
+		const struct rtmsg *r = NLMSG_DATA(n);
+
+		family = r->rtm_family;
+		rta = RTM_RTA(r);
+		len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*r));
+		types = 1 << RTA_DST | 1 << RTA_SRC |
+			1 << RTA_GATEWAY | 1 << RTA_PREFSRC;
+		break;
+	}
+	case RTM_NEWADDR:
+	case RTM_DELADDR: {
+		const struct ifaddrmsg *ifa = NLMSG_DATA(n);
+
+		family = ifa->ifa_family;
+		rta = IFA_RTA(ifa);
+		len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa));
+		types = 1 << IFA_ADDRESS | 1 << IFA_LOCAL;
+		break;
+	}
+	case RTM_NEWNEIGH:
+	case RTM_DELNEIGH: {
+		const struct ndmsg *ndm = NLMSG_DATA(n);
+
+		family = ndm->ndm_family;
+		rta = (const struct rtattr *)((const char *)ndm +
+					      NLMSG_ALIGN(sizeof(*ndm)));
+		len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*ndm));
+		types = 1 << NDA_DST;
+		break;
+	}
+	default:
+		return;
+	}
+
+	if (len <= 0 || af_byte_len(family) <= 0)
+		return;
+
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type < 32 && (types & 1 << rta->rta_type) &&
+		    RTA_PAYLOAD(rta) == af_byte_len(family))
+			resolve_prefetch(family, RTA_PAYLOAD(rta),
+					 RTA_DATA(rta));
+	}
+}
+
+/* The name is copied out under nht_lock, a refresh frees the old one */
+static const char *resolve_address(const void *addr, int len, int af,
+				   char *buf, int buflen)
+{
+	const char *name = NULL;
+	struct namerec *n;
+
+	pthread_mutex_lock(&nht_lock);
+	n = namerec_get(addr, len, af);
+	if (n && n->state != NAMEREC_DONE && !n->name) {
+		fflush(stdout);
+		/* nobody has got to it yet, so do not wait for them */
+		if (n->state == NAMEREC_QUEUED)
+			namerec_lookup(n);
+		while (n->state != NAMEREC_DONE)
+			pthread_cond_wait(&nht_done, &nht_lock);
+	}
+	if (n && n->name) {
+		strlcpy(buf, n->name, buflen);
+		name = buf;
+	}
+	pthread_mutex_unlock(&nht_lock);
+
+	return name;
+}
+#else
+void resolve_prefetch(int af, int len, const void *addr)
+{
+}
+
+void resolve_prefetch_nlmsg(const struct nlmsghdr *n)
+{
 }
 #endif
 
@@ -1122,7 +1415,7 @@ const char *format_host_r(int af, int len, const void *addr,
 		len = len <= 0 ? af_byte_len(af) : len;
 
 		if (len > 0 &&
-		    (n = resolve_address(addr, len, af)) != NULL)
+		    (n = resolve_address(addr, len, af, buf, buflen)) != NULL)
 			return n;
 	}
 #endif
@@ -28,6 +28,8 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "utils.h"
 #include "rt_names.h"
@@ -189,6 +191,16 @@ static struct {
 	int chunks;		/* Number of allocated chunks */
 } buffer;
 
+/* --stream: the columns are sized from the first stream_sample rows, then
+ * each row is rendered as soon as it is complete, with the same widths.
+ */
+#define STREAM_SAMPLE	1000
+#define STREAM_BUF	(1024 * 1024)
+
+static int stream_sample = -1;
+static unsigned int stream_rows;
+static bool stream_fixed;
+
 static const char *TCP_PROTO = "tcp";
 static const char *SCTP_PROTO = "sctp";
 static const char *UDP_PROTO = "udp";
@@ -261,6 +273,7 @@ struct filter {
 	struct ssfilter *f;
 	bool kill;
 	struct rtnl_handle *rth_for_killing;
+	FILE *dump_fp;	/* keep the raw dump here instead of showing it */
 };
 
 #define FAMILY_MASK(family) ((uint64_t)1 << (family))
@@ -505,171 +518,483 @@ static FILE *generic_proc_open(const char *env, const char *name)
 #define ephemeral_ports_open()	generic_proc_open("PROC_IP_LOCAL_PORT_RANGE", \
 					"sys/net/ipv4/ip_local_port_range")
 
+/* What is shown about a process, shared by all of its sockets */
+struct user_proc {
+	struct user_proc *next;
+	int		pid;
+	char		*process;
+	char		*process_ctx;
+};
+
 struct user_ent {
 	struct user_ent	*next;
 	unsigned int	ino;
 	int		pid;
 	int		fd;
-	char		*process;
-	char		*process_ctx;
+	struct user_proc *proc;
 	char		*socket_ctx;
 };
 
-#define USER_ENT_HASH_SIZE	256
-static struct user_ent *user_ent_hash[USER_ENT_HASH_SIZE];
+/* Owners of socket inodes, found by a scan of /proc/PID/fd/ */
+static struct user_ent **user_ent_hash;
+static unsigned int user_ent_hash_bits;
+static unsigned int user_ent_count;
+static int user_ent_complete;	/* every socket of every process is in */
+static struct user_proc *user_procs;
+
+/* Inodes of the sockets printed so far; the text that replaces their
+ * marker in the output is made once the scan has found their owners.
+ * They are kept in order, with an open addressing index into them, so
+ * that forgetting them costs no more than remembering them did.
+ */
+struct user_want {
+	unsigned int	ino;
+	unsigned int	slot;	/* in user_want_index */
+	int		seen;
+	char		*text;
+};
+
+static struct user_want *user_want;
+static unsigned int user_want_alloc;
+static unsigned int user_want_count;
+static unsigned int user_want_pending;
+static unsigned int *user_want_index;	/* user_want entry + 1, or 0 */
+static unsigned int user_want_size;
+
+static int first_owner;
+
+/* Stands for the owners of a socket in the output until it is rendered:
+ * USER_MARK, the inode as 8 hex digits, USER_MARK_END.
+ */
+#define USER_MARK	'\001'
+#define USER_MARK_END	'\002'
+#define USER_MARK_LEN	10
 
-static int user_ent_hashfn(unsigned int ino)
+#define USER_SCAN_WORKERS	16
+
+static unsigned int user_ent_hashfn(unsigned int ino, unsigned int bits)
 {
-	int val = (ino >> 24) ^ (ino >> 16) ^ (ino >> 8) ^ ino;
+	return (ino * 0x9e3779b1U) >> (32 - bits);
+}
+
+static void user_ent_rehash(void)
+{
+	unsigned int bits = user_ent_hash_bits ? user_ent_hash_bits + 1 : 8;
+	struct user_ent **hash, *p, *next;
+	unsigned int i;
 
-	return val & (USER_ENT_HASH_SIZE - 1);
+	hash = calloc(1U << bits, sizeof(*hash));
+	if (!hash) {
+		fprintf(stderr, "ss: failed to malloc buffer\n");
+		abort();
+	}
+
+	/* keep the order of each chain */
+	for (i = 0; user_ent_hash_bits && i < 1U << user_ent_hash_bits; i++) {
+		for (p = user_ent_hash[i]; p; p = next) {
+			struct user_ent **pp;
+
+			next = p->next;
+			p->next = NULL;
+			pp = &hash[user_ent_hashfn(p->ino, bits)];
+			while (*pp)
+				pp = &(*pp)->next;
+			*pp = p;
+		}
+	}
+
+	free(user_ent_hash);
+	user_ent_hash = hash;
+	user_ent_hash_bits = bits;
 }
 
-static void user_ent_add(unsigned int ino, char *process,
-					int pid, int fd,
-					char *proc_ctx,
-					char *sock_ctx)
+static void user_ent_add(unsigned int ino, struct user_proc *proc, int fd)
 {
 	struct user_ent *p, **pp;
 
-	p = malloc(sizeof(struct user_ent));
+	if (!user_ent_hash || user_ent_count >= 1U << user_ent_hash_bits)
+		user_ent_rehash();
+
+	p = calloc(1, sizeof(struct user_ent));
 	if (!p) {
 		fprintf(stderr, "ss: failed to malloc buffer\n");
 		abort();
 	}
-	p->next = NULL;
 	p->ino = ino;
-	p->pid = pid;
+	p->pid = proc->pid;
 	p->fd = fd;
-	p->process = strdup(process);
-	p->process_ctx = strdup(proc_ctx);
-	p->socket_ctx = strdup(sock_ctx);
+	p->proc = proc;
 
-	pp = &user_ent_hash[user_ent_hashfn(ino)];
+	pp = &user_ent_hash[user_ent_hashfn(ino, user_ent_hash_bits)];
 	p->next = *pp;
 	*pp = p;
+	user_ent_count++;
+}
+
+/* Forget the sockets printed so far, once they have been rendered */
+static void user_want_reset(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < user_want_count; i++) {
+		free(user_want[i].text);
+		user_want_index[user_want[i].slot] = 0;
+	}
+	user_want_count = user_want_pending = 0;
 }
 
 static void user_ent_destroy(void)
 {
 	struct user_ent *p, *p_next;
-	int cnt = 0;
+	unsigned int cnt;
 
-	while (cnt != USER_ENT_HASH_SIZE) {
+	for (cnt = 0; user_ent_hash_bits && cnt < 1U << user_ent_hash_bits;
+	     cnt++) {
 		p = user_ent_hash[cnt];
 		while (p) {
-			free(p->process);
-			free(p->process_ctx);
 			free(p->socket_ctx);
 			p_next = p->next;
 			free(p);
 			p = p_next;
 		}
-		cnt++;
 	}
+	free(user_ent_hash);
+	user_ent_hash = NULL;
+	user_ent_hash_bits = 0;
+	user_ent_count = 0;
+
+	while (user_procs) {
+		struct user_proc *proc = user_procs;
+
+		user_procs = proc->next;
+		free(proc->process);
+		free(proc->process_ctx);
+		free(proc);
+	}
+
+	user_want_reset();
+	free(user_want);
+	user_want = NULL;
+	user_want_alloc = 0;
+	free(user_want_index);
+	user_want_index = NULL;
+	user_want_size = 0;
 }
 
-static void user_ent_hash_build(void)
+static struct user_want *user_want_find(unsigned int ino)
 {
-	const char *root = getenv("PROC_ROOT") ? : "/proc/";
-	struct dirent *d;
-	char name[1024];
-	int nameoff;
-	DIR *dir;
-	char *pid_context;
-	char *sock_context;
-	const char *no_ctx = "unavailable";
-	static int user_ent_hash_build_init;
+	unsigned int i;
+
+	if (!user_want_size)
+		return NULL;
+
+	for (i = user_ent_hashfn(ino, 32) & (user_want_size - 1);
+	     user_want_index[i]; i = (i + 1) & (user_want_size - 1))
+		if (user_want[user_want_index[i] - 1].ino == ino)
+			return &user_want[user_want_index[i] - 1];
+	return NULL;
+}
+
+static void user_want_index_add(unsigned int n)
+{
+	unsigned int i;
 
-	/* If show_users & show_proc_ctx set only do this once */
-	if (user_ent_hash_build_init != 0)
+	for (i = user_ent_hashfn(user_want[n].ino, 32) & (user_want_size - 1);
+	     user_want_index[i]; i = (i + 1) & (user_want_size - 1))
+		;
+	user_want_index[i] = n + 1;
+	user_want[n].slot = i;
+}
+
+/* Remember a socket whose owners are to be shown */
+static void user_want_add(unsigned int ino)
+{
+	unsigned int i;
+
+	if (user_want_find(ino))
 		return;
 
-	user_ent_hash_build_init = 1;
+	if (user_want_count == user_want_alloc) {
+		user_want_alloc = user_want_alloc ? user_want_alloc * 2 : 128;
+		user_want = realloc(user_want,
+				    user_want_alloc * sizeof(*user_want));
+		if (!user_want) {
+			fprintf(stderr, "ss: failed to malloc buffer\n");
+			abort();
+		}
+	}
+
+	if (2 * (user_want_count + 1) > user_want_size) {
+		user_want_size = user_want_size ? user_want_size * 2 : 256;
+		free(user_want_index);
+		user_want_index = calloc(user_want_size,
+					 sizeof(*user_want_index));
+		if (!user_want_index) {
+			fprintf(stderr, "ss: failed to malloc buffer\n");
+			abort();
+		}
+		for (i = 0; i < user_want_count; i++)
+			user_want_index_add(i);
+	}
+
+	user_want[user_want_count] = (struct user_want) { .ino = ino };
+	user_want_index_add(user_want_count);
+	user_want_count++;
+	user_want_pending++;
+}
 
-	strlcpy(name, root, sizeof(name));
+struct user_hit {
+	unsigned int	ino;
+	int		fd;
+	int		pidx;
+	int		seq;
+};
 
-	if (strlen(name) == 0 || name[strlen(name)-1] != '/')
-		strcat(name, "/");
+struct user_scan {
+	const char	*root;
+	int		*pids;
+	int		npids;
+	int		next;
+	bool		everything;
+	unsigned int	found;
+	bool		stop;
+	struct user_hit	*hits;
+	size_t		nhits;
+	size_t		size;
+	pthread_mutex_t	lock;
+};
 
-	nameoff = strlen(name);
+static void user_scan_pid(struct user_scan *sc, int pidx)
+{
+	struct user_hit *hits = NULL;
+	size_t nhits = 0, size = 0;
+	char name[PATH_MAX];
+	struct dirent *d;
+	DIR *dir;
+	int pos, seq = 0;
+	size_t i;
 
+	pos = snprintf(name, sizeof(name), "%s%d/fd/",
+		       sc->root, sc->pids[pidx]);
+	if (pos >= sizeof(name))
+		return;
 	dir = opendir(name);
 	if (!dir)
 		return;
 
 	while ((d = readdir(dir)) != NULL) {
-		struct dirent *d1;
-		char process[16];
-		char *p;
-		int pid, pos;
-		DIR *dir1;
+		const char *pattern = "socket:[";
+		unsigned int ino;
+		char lnk[64];
+		ssize_t link_len;
 		char crap;
+		int fd;
 
-		if (sscanf(d->d_name, "%d%c", &pid, &crap) != 1)
+		if (sscanf(d->d_name, "%d%c", &fd, &crap) != 1)
 			continue;
 
-		if (getpidcon(pid, &pid_context) != 0)
-			pid_context = strdup(no_ctx);
+		snprintf(name + pos, sizeof(name) - pos, "%d", fd);
 
-		snprintf(name + nameoff, sizeof(name) - nameoff, "%d/fd/", pid);
-		pos = strlen(name);
-		if ((dir1 = opendir(name)) == NULL) {
-			free(pid_context);
+		link_len = readlink(name, lnk, sizeof(lnk)-1);
+		if (link_len == -1)
+			continue;
+		lnk[link_len] = '\0';
+
+		if (strncmp(lnk, pattern, strlen(pattern)))
 			continue;
-		}
 
-		process[0] = '\0';
-		p = process;
+		if (sscanf(lnk, "socket:[%u]", &ino) != 1)
+			continue;
 
-		while ((d1 = readdir(dir1)) != NULL) {
-			const char *pattern = "socket:[";
-			unsigned int ino;
-			char lnk[64];
-			int fd;
-			ssize_t link_len;
-			char tmp[1024];
+		if (!sc->everything) {
+			struct user_want *w = user_want_find(ino);
 
-			if (sscanf(d1->d_name, "%d%c", &fd, &crap) != 1)
+			if (!w || w->text)
 				continue;
+		}
 
-			snprintf(name+pos, sizeof(name) - pos, "%d", fd);
+		if (nhits == size) {
+			size = size ? size * 2 : 16;
+			hits = realloc(hits, size * sizeof(*hits));
+			if (!hits) {
+				fprintf(stderr, "ss: failed to malloc buffer\n");
+				abort();
+			}
+		}
+		hits[nhits++] = (struct user_hit) {
+			.ino = ino, .fd = fd, .pidx = pidx, .seq = seq++,
+		};
+	}
+	closedir(dir);
 
-			link_len = readlink(name, lnk, sizeof(lnk)-1);
-			if (link_len == -1)
-				continue;
-			lnk[link_len] = '\0';
+	if (!nhits)
+		return;
 
-			if (strncmp(lnk, pattern, strlen(pattern)))
-				continue;
+	pthread_mutex_lock(&sc->lock);
+	if (sc->nhits + nhits > sc->size) {
+		sc->size = sc->size ? sc->size * 2 : 256;
+		if (sc->size < sc->nhits + nhits)
+			sc->size = sc->nhits + nhits;
+		sc->hits = realloc(sc->hits, sc->size * sizeof(*sc->hits));
+		if (!sc->hits) {
+			fprintf(stderr, "ss: failed to malloc buffer\n");
+			abort();
+		}
+	}
+	memcpy(sc->hits + sc->nhits, hits, nhits * sizeof(*hits));
+	sc->nhits += nhits;
 
-			sscanf(lnk, "socket:[%u]", &ino);
+	for (i = 0; i < nhits; i++) {
+		struct user_want *w = user_want_find(hits[i].ino);
 
-			snprintf(tmp, sizeof(tmp), "%s/%d/fd/%s",
-					root, pid, d1->d_name);
+		if (w && !w->text && !w->seen) {
+			w->seen = 1;
+			sc->found++;
+		}
+	}
+	if (first_owner && !sc->everything && sc->found == user_want_pending)
+		sc->stop = true;
+	pthread_mutex_unlock(&sc->lock);
 
-			if (getfilecon(tmp, &sock_context) <= 0)
-				sock_context = strdup(no_ctx);
+	free(hits);
+}
 
-			if (*p == '\0') {
-				FILE *fp;
+static void *user_scan_worker(void *arg)
+{
+	struct user_scan *sc = arg;
 
-				snprintf(tmp, sizeof(tmp), "%s/%d/stat",
-					root, pid);
-				if ((fp = fopen(tmp, "r")) != NULL) {
-					if (fscanf(fp, "%*d (%[^)])", p) < 1)
-						; /* ignore */
-					fclose(fp);
-				}
+	for (;;) {
+		int pidx;
+
+		pthread_mutex_lock(&sc->lock);
+		pidx = sc->stop ? sc->npids : sc->next++;
+		pthread_mutex_unlock(&sc->lock);
+		if (pidx >= sc->npids)
+			break;
+
+		user_scan_pid(sc, pidx);
+	}
+	return NULL;
+}
+
+/* Same order as a walk of /proc that adds each owner at the head */
+static int user_hit_cmp(const void *a, const void *b)
+{
+	const struct user_hit *x = a, *y = b;
+
+	if (x->pidx != y->pidx)
+		return x->pidx - y->pidx;
+	return x->seq - y->seq;
+}
+
+/* Look for the owners of the sockets in user_want, or of all sockets, with
+ * the processes split among worker threads.
+ */
+static void user_ent_scan(bool everything)
+{
+	struct user_scan sc = {
+		.root = getenv("PROC_ROOT") ? : "/proc/",
+		.everything = everything,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	pthread_t workers[USER_SCAN_WORKERS];
+	struct user_proc *proc = NULL;
+	int nworkers, npids = 0, i;
+	char root[PATH_MAX];
+	struct dirent *d;
+	size_t n;
+	DIR *dir;
+
+	snprintf(root, sizeof(root), "%s%s", sc.root,
+		 sc.root[0] && sc.root[strlen(sc.root) - 1] == '/' ? "" : "/");
+	sc.root = root;
+
+	dir = opendir(root);
+	if (!dir)
+		return;
+
+	while ((d = readdir(dir)) != NULL) {
+		char crap;
+		int pid;
+
+		if (sscanf(d->d_name, "%d%c", &pid, &crap) != 1)
+			continue;
+		if (sc.npids == npids) {
+			npids = npids ? npids * 2 : 256;
+			sc.pids = realloc(sc.pids, npids * sizeof(int));
+			if (!sc.pids) {
+				fprintf(stderr, "ss: failed to malloc buffer\n");
+				abort();
 			}
-			user_ent_add(ino, p, pid, fd,
-					pid_context, sock_context);
-			free(sock_context);
 		}
-		free(pid_context);
-		closedir(dir1);
+		sc.pids[sc.npids++] = pid;
 	}
 	closedir(dir);
+
+	nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	nworkers = min(nworkers, USER_SCAN_WORKERS);
+	nworkers = min(nworkers, sc.npids / 16 + 1);
+
+	for (i = 1; i < nworkers; i++)
+		if (pthread_create(&workers[i], NULL, user_scan_worker, &sc))
+			break;
+	nworkers = i;
+	user_scan_worker(&sc);
+	for (i = 1; i < nworkers; i++)
+		pthread_join(workers[i], NULL);
+
+	qsort(sc.hits, sc.nhits, sizeof(*sc.hits), user_hit_cmp);
+	for (n = 0; n < sc.nhits; n++) {
+		if (!n || sc.hits[n].pidx != sc.hits[n - 1].pidx) {
+			proc = calloc(1, sizeof(*proc));
+			if (!proc) {
+				fprintf(stderr, "ss: failed to malloc buffer\n");
+				abort();
+			}
+			proc->pid = sc.pids[sc.hits[n].pidx];
+			proc->next = user_procs;
+			user_procs = proc;
+		}
+		user_ent_add(sc.hits[n].ino, proc, sc.hits[n].fd);
+	}
+
+	free(sc.hits);
+	free(sc.pids);
+	pthread_mutex_destroy(&sc.lock);
+}
+
+/* Read what is shown about an owner only when it is shown */
+static void user_ent_fill(struct user_ent *p)
+{
+	const char *root = getenv("PROC_ROOT") ? : "/proc/";
+	const char *no_ctx = "unavailable";
+	char tmp[PATH_MAX];
+
+	struct user_proc *proc = p->proc;
+
+	if (!proc->process) {
+		char process[16] = "";
+		FILE *fp;
+
+		snprintf(tmp, sizeof(tmp), "%s/%d/stat", root, proc->pid);
+		if ((fp = fopen(tmp, "r")) != NULL) {
+			if (fscanf(fp, "%*d (%15[^)])", process) < 1)
+				; /* ignore */
+			fclose(fp);
+		}
+		proc->process = strdup(process);
+	}
+
+	if (show_proc_ctx && !proc->process_ctx) {
+		if (getpidcon(proc->pid, &proc->process_ctx) != 0)
+			proc->process_ctx = strdup(no_ctx);
+	}
+
+	if (show_sock_ctx && !p->socket_ctx) {
+		snprintf(tmp, sizeof(tmp), "%s/%d/fd/%d", root, p->pid, p->fd);
+		if (getfilecon(tmp, &p->socket_ctx) <= 0)
+			p->socket_ctx = strdup(no_ctx);
+	}
 }
 
 enum entry_types {
@@ -692,31 +1017,35 @@ static int find_entry(unsigned int ino, char **buf, int type)
 	if (!ino)
 		return 0;
 
-	p = user_ent_hash[user_ent_hashfn(ino)];
 	ptr = *buf = NULL;
+	if (!user_ent_hash_bits)
+		return 0;
+
+	p = user_ent_hash[user_ent_hashfn(ino, user_ent_hash_bits)];
 	while (p) {
 		if (p->ino != ino)
 			goto next;
 
+		user_ent_fill(p);
 		while (1) {
 			ptr = *buf + buf_used;
 			switch (type) {
 			case USERS:
 				len = snprintf(ptr, buf_len - buf_used,
 					"(\"%s\",pid=%d,fd=%d),",
-					p->process, p->pid, p->fd);
+					p->proc->process, p->pid, p->fd);
 				break;
 			case PROC_CTX:
 				len = snprintf(ptr, buf_len - buf_used,
 					"(\"%s\",pid=%d,proc_ctx=%s,fd=%d),",
-					p->process, p->pid,
-					p->process_ctx, p->fd);
+					p->proc->process, p->pid,
+					p->proc->process_ctx, p->fd);
 				break;
 			case PROC_SOCK_CTX:
 				len = snprintf(ptr, buf_len - buf_used,
 					"(\"%s\",pid=%d,proc_ctx=%s,fd=%d,sock_ctx=%s),",
-					p->process, p->pid,
-					p->process_ctx, p->fd,
+					p->proc->process, p->pid,
+					p->proc->process_ctx, p->fd,
 					p->socket_ctx);
 				break;
 			default:
@@ -740,6 +1069,8 @@ static int find_entry(unsigned int ino, char **buf, int type)
 			}
 		}
 		cnt++;
+		if (first_owner)
+			break;
 next:
 		p = p->next;
 	}
@@ -750,11 +1081,68 @@ next:
 	return cnt;
 }
 
+/* Find the owners of the sockets printed since the last call and make
+ * the text for them.  When more output is to come, all sockets are looked
+ * up at once, so that /proc is walked once only, even if only the first
+ * owner of each is wanted.
+ */
+static void user_ent_resolve(bool more)
+{
+	unsigned int i;
+	int type;
+
+	if (!user_want_pending)
+		return;
+
+	if (!user_ent_complete) {
+		user_ent_scan(more);
+		user_ent_complete = more;
+	}
+
+	if (show_proc_ctx || show_sock_ctx)
+		type = (show_proc_ctx & show_sock_ctx) ?
+			PROC_SOCK_CTX : PROC_CTX;
+	else
+		type = USERS;
+
+	for (i = 0; i < user_want_count; i++) {
+		struct user_want *w = &user_want[i];
+		char *buf;
+
+		if (w->text)
+			continue;
+
+		if (find_entry(w->ino, &buf, type) > 0) {
+			if (asprintf(&w->text, " users:(%s)", buf) < 0)
+				w->text = NULL;
+			free(buf);
+		}
+		if (!w->text)
+			w->text = strdup("");
+	}
+	user_want_pending = 0;
+}
+
 static unsigned long long cookie_sk_get(const uint32_t *cookie)
 {
 	return (((unsigned long long)cookie[1] << 31) << 1) | cookie[0];
 }
 
+static const char * const sstate_name[] = {
+	"UNKNOWN",
+	[SS_ESTABLISHED] = "ESTAB",
+	[SS_SYN_SENT] = "SYN-SENT",
+	[SS_SYN_RECV] = "SYN-RECV",
+	[SS_FIN_WAIT1] = "FIN-WAIT-1",
+	[SS_FIN_WAIT2] = "FIN-WAIT-2",
+	[SS_TIME_WAIT] = "TIME-WAIT",
+	[SS_CLOSE] = "UNCONN",
+	[SS_CLOSE_WAIT] = "CLOSE-WAIT",
+	[SS_LAST_ACK] = "LAST-ACK",
+	[SS_LISTEN] =	"LISTEN",
+	[SS_CLOSING] = "CLOSING",
+};
+
 static const char *sctp_sstate_name[] = {
 	[SCTP_STATE_CLOSED] = "CLOSED",
 	[SCTP_STATE_COOKIE_WAIT] = "COOKIE_WAIT",
@@ -1067,11 +1455,71 @@ static void print_right_spacing(struct column *f, int printed)
 		printf("%*c", s, ' ');
 }
 
+/* Inode in the owner marker at p, 0 if there is none */
+static unsigned int user_mark_ino(const char *p, const char *end)
+{
+	unsigned int ino;
+	char hex[9];
+
+	if (end - p < USER_MARK_LEN || p[0] != USER_MARK ||
+	    p[USER_MARK_LEN - 1] != USER_MARK_END)
+		return 0;
+
+	memcpy(hex, p + 1, 8);
+	hex[8] = '\0';
+	if (strspn(hex, "0123456789abcdef") != 8 ||
+	    sscanf(hex, "%x", &ino) != 1)
+		return 0;
+	return ino;
+}
+
+/* Length of token content with owner markers replaced, print it if asked */
+static int token_expand(const char *data, int len, bool print)
+{
+	const char *p = data, *end = data + len, *m;
+	int n = 0;
+
+	while ((m = memchr(p, USER_MARK, end - p)) != NULL) {
+		unsigned int ino = user_mark_ino(m, end);
+		struct user_want *w;
+		const char *text;
+
+		if (!ino) {
+			m++;
+			if (print)
+				fwrite(p, 1, m - p, stdout);
+			n += m - p;
+			p = m;
+			continue;
+		}
+
+		w = user_want_find(ino);
+		text = w && w->text ? w->text : "";
+		if (print) {
+			fwrite(p, 1, m - p, stdout);
+			fputs(text, stdout);
+		}
+		n += (m - p) + strlen(text);
+		p = m + USER_MARK_LEN;
+	}
+	if (print)
+		fwrite(p, 1, end - p, stdout);
+	return n + (end - p);
+}
+
+static int token_len(const struct buf_token *t)
+{
+	if (!user_want_count || !memchr(t->data, USER_MARK, t->len))
+		return t->len;
+	return token_expand(t->data, t->len, false);
+}
+
 /* Done with field: update buffer pointer, start new token after current one */
 static void field_flush(struct column *f)
 {
 	struct buf_chunk *chunk;
 	unsigned int pad;
+	int len;
 
 	if (f->disabled)
 		return;
@@ -1079,8 +1527,9 @@ static void field_flush(struct column *f)
 	chunk = buffer.tail;
 	pad = buffer.cur->len % 2;
 
-	if (buffer.cur->len > f->max_len)
-		f->max_len = buffer.cur->len;
+	len = token_len(buffer.cur);
+	if (len > f->max_len)
+		f->max_len = len;
 
 	/* We need a new chunk if we can't store the next length descriptor.
 	 * Mind the gap between end of previous token and next aligned position
@@ -1131,6 +1580,33 @@ static void buf_free_all(void)
 	buffer.chunks = 0;
 }
 
+/* Now that the owners are known, widen columns for them as needed */
+static void render_users_width(void)
+{
+	struct buf_token *token = (struct buf_token *)buffer.head->data;
+	struct column *f = columns;
+
+	buffer.tail = buffer.head;
+	while (f->disabled)
+		f++;
+
+	while (token) {
+		int len = token_len(token);
+
+		if (len > f->max_len)
+			f->max_len = len;
+
+		do {
+			if (field_is_last(f))
+				f = columns;
+			else
+				f++;
+		} while (f->disabled);
+
+		token = buf_token_next(token);
+	}
+}
+
 /* Get current screen width, default to 80 columns if TIOCGWINSZ fails */
 static int render_screen_width(void)
 {
@@ -1237,11 +1713,13 @@ newline:
 	}
 }
 
-/* Render buffered output with spacing and delimiters, then free up buffers */
-static void render(void)
+/* Render buffered output with spacing and delimiters, then free up buffers;
+ * more is set if this is not the end of the output.
+ */
+static void render(bool more)
 {
 	struct buf_token *token;
-	int printed, line_started = 0;
+	int printed, len, line_started = 0;
 	struct column *f;
 
 	if (!buffer.head)
@@ -1252,7 +1730,15 @@ static void render(void)
 	/* Ensure end alignment of last token, it wasn't necessarily flushed */
 	buffer.tail->end += buffer.cur->len % 2;
 
-	render_calc_width();
+	if (user_want_pending) {
+		user_ent_resolve(more);
+		render_users_width();
+	}
+
+	if (!stream_fixed)
+		render_calc_width();
+	if (stream_sample >= 0)
+		stream_fixed = true;
 
 	/* Rewind and replay */
 	buffer.tail = buffer.head;
@@ -1269,8 +1755,12 @@ static void render(void)
 			printed = 0;
 
 		/* Print field content from token data with spacing */
-		printed += print_left_spacing(f, token->len, printed);
-		printed += fwrite(token->data, 1, token->len, stdout);
+		len = token_len(token);
+		printed += print_left_spacing(f, len, printed);
+		if (len != token->len)
+			printed += token_expand(token->data, token->len, true);
+		else
+			printed += fwrite(token->data, 1, token->len, stdout);
 		print_right_spacing(f, printed);
 
 		/* Go to next non-empty field, deal with end-of-line */
@@ -1288,16 +1778,27 @@ static void render(void)
 	}
 
 	buf_free_all();
+	user_want_reset();
 	current_field = columns;
 }
 
+/* In streaming mode, count a complete row and tell if it's time to render */
+static bool stream_row_end(void)
+{
+	if (stream_sample < 0)
+		return false;
+
+	return ++stream_rows >= stream_sample;
+}
+
 /* Move to next field, and render buffer if we reached the maximum number of
- * chunks, at the last field in a line.
+ * chunks, or in streaming mode, at the last field in a line.
  */
 static void field_next(void)
 {
-	if (field_is_last(current_field) && buffer.chunks >= BUF_CHUNKS_MAX) {
-		render();
+	if (field_is_last(current_field) &&
+	    (buffer.chunks >= BUF_CHUNKS_MAX || stream_row_end())) {
+		render(true);
 		return;
 	}
 
@@ -1328,20 +1829,6 @@ static void print_header(void)
 static void sock_state_print(struct sockstat *s)
 {
 	const char *sock_name;
-	static const char * const sstate_name[] = {
-		"UNKNOWN",
-		[SS_ESTABLISHED] = "ESTAB",
-		[SS_SYN_SENT] = "SYN-SENT",
-		[SS_SYN_RECV] = "SYN-RECV",
-		[SS_FIN_WAIT1] = "FIN-WAIT-1",
-		[SS_FIN_WAIT2] = "FIN-WAIT-2",
-		[SS_TIME_WAIT] = "TIME-WAIT",
-		[SS_CLOSE] = "UNCONN",
-		[SS_CLOSE_WAIT] = "CLOSE-WAIT",
-		[SS_LAST_ACK] = "LAST-ACK",
-		[SS_LISTEN] =	"LISTEN",
-		[SS_CLOSING] = "CLOSING",
-	};
 
 	switch (s->local.family) {
 	case AF_UNIX:
@@ -1446,14 +1933,24 @@ struct scache {
 };
 
 static struct scache *rlist;
+static FILE *rpcinfo_fp;
 
+/* Start asking for the RPC services; rpcinfo can take its time, so the
+ * answer is only read once a port is first looked up
+ */
 static void init_service_resolver(void)
 {
+	rpcinfo_fp = popen("/usr/sbin/rpcinfo -p 2>/dev/null", "r");
+}
+
+static void read_rpc_services(void)
+{
+	FILE *fp = rpcinfo_fp;
 	char buf[128];
-	FILE *fp = popen("/usr/sbin/rpcinfo -p 2>/dev/null", "r");
 
 	if (!fp)
 		return;
+	rpcinfo_fp = NULL;
 
 	if (!fgets(buf, sizeof(buf), fp)) {
 		pclose(fp);
@@ -1515,6 +2012,7 @@ static const char *__resolve_service(int port)
 {
 	struct scache *c;
 
+	read_rpc_services();
 	for (c = rlist; c; c = c->next) {
 		if (c->port == port && c->proto == dg_proto)
 			return c->name;
@@ -2216,6 +2714,7 @@ void *parse_hostcond(char *addr, bool is_port)
 				} else {
 					struct scache *s;
 
+					read_rpc_services();
 					for (s = rlist; s; s = s->next) {
 						if ((s->proto == UDP_PROTO &&
 						     (current_filter.dbs&(1<<UDP_DB))) ||
@@ -2280,23 +2779,14 @@ void *parse_markmask(const char *markmask)
 	return res;
 }
 
+/* The owners are only looked up when the output is rendered */
 static void proc_ctx_print(struct sockstat *s)
 {
-	char *buf;
+	if (!s->ino || !(show_users || show_proc_ctx || show_sock_ctx))
+		return;
 
-	if (show_proc_ctx || show_sock_ctx) {
-		if (find_entry(s->ino, &buf,
-				(show_proc_ctx & show_sock_ctx) ?
-				PROC_SOCK_CTX : PROC_CTX) > 0) {
-			out(" users:(%s)", buf);
-			free(buf);
-		}
-	} else if (show_users) {
-		if (find_entry(s->ino, &buf, USERS) > 0) {
-			out(" users:(%s)", buf);
-			free(buf);
-		}
-	}
+	user_want_add(s->ino);
+	out("%c%08x%c", USER_MARK, s->ino, USER_MARK_END);
 }
 
 static void inet_stats_print(struct sockstat *s, bool v6only)
@@ -2547,60 +3037,447 @@ static void tcp_stats_print(struct tcpstat *s)
 			    100.0 * s->sndbuf_limited / s->busy_time);
 	}
 
-	if (s->unacked)
-		out(" unacked:%u", s->unacked);
-	if (s->retrans || s->retrans_total)
-		out(" retrans:%u/%u", s->retrans, s->retrans_total);
-	if (s->lost)
-		out(" lost:%u", s->lost);
-	if (s->sacked && s->ss.state != SS_LISTEN)
-		out(" sacked:%u", s->sacked);
-	if (s->dsack_dups)
-		out(" dsack_dups:%u", s->dsack_dups);
-	if (s->fackets)
-		out(" fackets:%u", s->fackets);
-	if (s->reordering != 3)
-		out(" reordering:%d", s->reordering);
-	if (s->reord_seen)
-		out(" reord_seen:%d", s->reord_seen);
-	if (s->rcv_rtt)
-		out(" rcv_rtt:%g", s->rcv_rtt);
-	if (s->rcv_space)
-		out(" rcv_space:%d", s->rcv_space);
-	if (s->rcv_ssthresh)
-		out(" rcv_ssthresh:%u", s->rcv_ssthresh);
-	if (s->not_sent)
-		out(" notsent:%u", s->not_sent);
-	if (s->min_rtt)
-		out(" minrtt:%g", s->min_rtt);
+	if (s->unacked)
+		out(" unacked:%u", s->unacked);
+	if (s->retrans || s->retrans_total)
+		out(" retrans:%u/%u", s->retrans, s->retrans_total);
+	if (s->lost)
+		out(" lost:%u", s->lost);
+	if (s->sacked && s->ss.state != SS_LISTEN)
+		out(" sacked:%u", s->sacked);
+	if (s->dsack_dups)
+		out(" dsack_dups:%u", s->dsack_dups);
+	if (s->fackets)
+		out(" fackets:%u", s->fackets);
+	if (s->reordering != 3)
+		out(" reordering:%d", s->reordering);
+	if (s->reord_seen)
+		out(" reord_seen:%d", s->reord_seen);
+	if (s->rcv_rtt)
+		out(" rcv_rtt:%g", s->rcv_rtt);
+	if (s->rcv_space)
+		out(" rcv_space:%d", s->rcv_space);
+	if (s->rcv_ssthresh)
+		out(" rcv_ssthresh:%u", s->rcv_ssthresh);
+	if (s->not_sent)
+		out(" notsent:%u", s->not_sent);
+	if (s->min_rtt)
+		out(" minrtt:%g", s->min_rtt);
+}
+
+static void tcp_timer_print(struct tcpstat *s)
+{
+	static const char * const tmr_name[] = {
+		"off",
+		"on",
+		"keepalive",
+		"timewait",
+		"persist",
+		"unknown"
+	};
+
+	if (s->timer) {
+		if (s->timer > 4)
+			s->timer = 5;
+		out(" timer:(%s,%s,%d)",
+			     tmr_name[s->timer],
+			     print_ms_timer(s->timeout),
+			     s->retrans);
+	}
+}
+
+static void sctp_timer_print(struct tcpstat *s)
+{
+	if (s->timer)
+		out(" timer:(T3_RTX,%s,%d)",
+		    print_ms_timer(s->timeout), s->retrans);
+}
+
+/* --group-by: inet sockets are counted per distinct key, made of the
+ * fields asked for, instead of being shown one by one.
+ */
+enum {
+	GROUP_NETID,
+	GROUP_STATE,
+	GROUP_SRC,
+	GROUP_DST,
+	GROUP_SPORT,
+	GROUP_DPORT,
+	GROUP_MAX
+};
+
+static const struct {
+	const char *name;
+	const char *header;
+} group_fields[GROUP_MAX] = {
+	[GROUP_NETID]	= { "netid",	"Netid" },
+	[GROUP_STATE]	= { "state",	"State" },
+	[GROUP_SRC]	= { "src",	"Local Address" },
+	[GROUP_DST]	= { "dst",	"Peer Address" },
+	[GROUP_SPORT]	= { "sport",	"Local Port" },
+	[GROUP_DPORT]	= { "dport",	"Peer Port" },
+};
+
+static int group_by[GROUP_MAX];		/* fields in the order asked for */
+static int group_nfields;
+static int group_src_prefix = -1;
+static int group_dst_prefix = -1;
+
+struct group_key {
+	__u8		type;
+	__u8		state;
+	__u16		family;
+	__u16		sport;
+	__u16		dport;
+	__u32		src[4];
+	__u32		dst[4];
+};
+
+struct group {
+	struct group	*next;
+	struct group_key key;
+	unsigned long long count;
+	unsigned long long rq;
+	unsigned long long wq;
+	unsigned long long tcpinfo;	/* sockets the rest is summed over */
+	unsigned long long unacked;
+	unsigned long long retrans;
+	unsigned long long lost;
+	unsigned long long bytes_acked;
+	unsigned long long bytes_received;
+	unsigned long long rtt;		/* usec */
+};
+
+static struct group **group_hash;
+static unsigned int group_hash_bits;
+static unsigned int group_count;
+
+static int group_by_parse(const char *arg)
+{
+	char *list = strdupa(arg), *name;
+
+	while ((name = strsep(&list, ",")) != NULL) {
+		char *prefix = strchr(name, '/');
+		unsigned int len;
+		int i;
+
+		if (prefix)
+			*prefix++ = '\0';
+		if (!strcmp(name, "lport"))
+			name = "sport";
+		else if (!strcmp(name, "rport"))
+			name = "dport";
+
+		for (i = 0; i < GROUP_MAX; i++)
+			if (!strcmp(name, group_fields[i].name))
+				break;
+		if (i == GROUP_MAX) {
+			fprintf(stderr, "ss: unknown group-by field \"%s\"\n",
+				name);
+			return -1;
+		}
+
+		if (prefix) {
+			if ((i != GROUP_SRC && i != GROUP_DST) ||
+			    get_unsigned(&len, prefix, 0) || len > 128) {
+				fprintf(stderr, "ss: invalid prefix \"%s/%s\"\n",
+					name, prefix);
+				return -1;
+			}
+			if (i == GROUP_SRC)
+				group_src_prefix = len;
+			else
+				group_dst_prefix = len;
+		}
+		group_by[group_nfields++] = i;
+		if (group_nfields == GROUP_MAX)
+			break;
+	}
+	return 0;
+}
+
+static void group_addr_mask(__u32 *dst, const inet_prefix *a, int prefix)
+{
+	int bits = a->bytelen * 8, i;
+
+	memcpy(dst, a->data, a->bytelen);
+	if (prefix < 0 || prefix >= bits)
+		return;
+
+	for (i = 0; i < a->bytelen / 4; i++) {
+		if (prefix >= 32)
+			prefix -= 32;
+		else if (prefix > 0) {
+			dst[i] &= htonl(~0U << (32 - prefix));
+			prefix = 0;
+		} else
+			dst[i] = 0;
+	}
+}
+
+static unsigned int group_hashfn(const struct group_key *key)
+{
+	const __u32 *p = (const __u32 *)key;
+	unsigned int h = 0, i;
+
+	for (i = 0; i < sizeof(*key) / sizeof(*p); i++)
+		h = (h ^ p[i]) * 0x9e3779b1U;
+	return h >> (32 - group_hash_bits);
+}
+
+static void group_rehash(void)
+{
+	unsigned int i, size = group_hash_bits ? 1U << group_hash_bits : 0;
+	struct group **old = group_hash, *g, *next;
+
+	group_hash_bits = group_hash_bits ? group_hash_bits + 1 : 8;
+	group_hash = calloc(1U << group_hash_bits, sizeof(*group_hash));
+	if (!group_hash) {
+		fprintf(stderr, "ss: failed to malloc buffer\n");
+		abort();
+	}
+	for (i = 0; i < size; i++) {
+		for (g = old[i]; g; g = next) {
+			struct group **gp = &group_hash[group_hashfn(&g->key)];
+
+			next = g->next;
+			g->next = *gp;
+			*gp = g;
+		}
+	}
+	free(old);
+}
+
+/* Count a socket that passed the filter in its group */
+static void group_add(const struct sockstat *s, const struct tcp_info *info)
+{
+	struct group_key key = {};
+	struct group *g, **gp;
+	int i;
+
+	for (i = 0; i < group_nfields; i++) {
+		switch (group_by[i]) {
+		case GROUP_NETID:
+			key.type = s->type;
+			break;
+		case GROUP_STATE:
+			key.state = s->state;
+			break;
+		case GROUP_SRC:
+			key.family = s->local.family;
+			group_addr_mask(key.src, &s->local, group_src_prefix);
+			break;
+		case GROUP_DST:
+			key.family = s->local.family;
+			group_addr_mask(key.dst, &s->remote, group_dst_prefix);
+			break;
+		case GROUP_SPORT:
+			key.sport = s->lport;
+			break;
+		case GROUP_DPORT:
+			key.dport = s->rport;
+			break;
+		}
+	}
+
+	if (group_count >= 1U << group_hash_bits || !group_hash)
+		group_rehash();
+
+	gp = &group_hash[group_hashfn(&key)];
+	for (g = *gp; g; g = g->next)
+		if (!memcmp(&g->key, &key, sizeof(key)))
+			break;
+	if (!g) {
+		g = calloc(1, sizeof(*g));
+		if (!g) {
+			fprintf(stderr, "ss: failed to malloc buffer\n");
+			abort();
+		}
+		g->key = key;
+		g->next = *gp;
+		*gp = g;
+		group_count++;
+	}
+
+	g->count++;
+	g->rq += s->rq;
+	g->wq += s->wq;
+	if (info) {
+		g->tcpinfo++;
+		g->unacked += info->tcpi_unacked;
+		g->retrans += info->tcpi_total_retrans;
+		g->lost += info->tcpi_lost;
+		g->bytes_acked += info->tcpi_bytes_acked;
+		g->bytes_received += info->tcpi_bytes_received;
+		g->rtt += info->tcpi_rtt;
+	}
 }
 
-static void tcp_timer_print(struct tcpstat *s)
+/* Biggest groups first, ties in key order so that the output is stable */
+static int group_cmp(const void *a, const void *b)
 {
-	static const char * const tmr_name[] = {
-		"off",
-		"on",
-		"keepalive",
-		"timewait",
-		"persist",
-		"unknown"
-	};
+	const struct group *x = *(const struct group **)a;
+	const struct group *y = *(const struct group **)b;
 
-	if (s->timer) {
-		if (s->timer > 4)
-			s->timer = 5;
-		out(" timer:(%s,%s,%d)",
-			     tmr_name[s->timer],
-			     print_ms_timer(s->timeout),
-			     s->retrans);
+	int i, d = 0;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+
+	for (i = 0; i < group_nfields && !d; i++) {
+		switch (group_by[i]) {
+		case GROUP_NETID:
+			d = x->key.type - y->key.type;
+			break;
+		case GROUP_STATE:
+			d = x->key.state - y->key.state;
+			break;
+		case GROUP_SRC:
+			d = x->key.family - y->key.family ? :
+			    memcmp(x->key.src, y->key.src, sizeof(x->key.src));
+			break;
+		case GROUP_DST:
+			d = x->key.family - y->key.family ? :
+			    memcmp(x->key.dst, y->key.dst, sizeof(x->key.dst));
+			break;
+		case GROUP_SPORT:
+			d = x->key.sport - y->key.sport;
+			break;
+		case GROUP_DPORT:
+			d = x->key.dport - y->key.dport;
+			break;
+		}
 	}
+	return d;
+}
+
+static char *group_field_text(const struct group *g, int field)
+{
+	const struct group_key *k = &g->key;
+	int len = k->family == AF_INET ? 4 : 16;
+	const __u32 *addr = field == GROUP_SRC ? k->src : k->dst;
+	int prefix = field == GROUP_SRC ? group_src_prefix : group_dst_prefix;
+	char buf[INET6_ADDRSTRLEN + 8];
+	char *text;
+
+	switch (field) {
+	case GROUP_NETID:
+		return strdup(proto_name(k->type));
+	case GROUP_STATE:
+		return strdup(sstate_name[k->state]);
+	case GROUP_SRC:
+	case GROUP_DST:
+		if (prefix < 0 || prefix >= len * 8)
+			return strdup(format_host(k->family, len, addr));
+		inet_ntop(k->family, addr, buf, sizeof(buf));
+		if (asprintf(&text, "%s/%d", buf, prefix) < 0)
+			return NULL;
+		return text;
+	case GROUP_SPORT:
+		return strdup(resolve_service(k->sport));
+	case GROUP_DPORT:
+		return strdup(resolve_service(k->dport));
+	}
+	return NULL;
 }
 
-static void sctp_timer_print(struct tcpstat *s)
+static void group_print(void)
 {
-	if (s->timer)
-		out(" timer:(T3_RTX,%s,%d)",
-		    print_ms_timer(s->timeout), s->retrans);
+	static const char * const sums[] = {
+		"Count", "Recv-Q", "Send-Q", "Unacked", "Retrans", "Lost",
+		"Bytes-Acked", "Bytes-Received", "RTT(ms)",
+	};
+	int nsums = show_tcpinfo ? ARRAY_SIZE(sums) : 3;
+	int ncols = group_nfields + nsums;
+	int width[GROUP_MAX + ARRAY_SIZE(sums)];
+	struct group **groups, *g;
+	char ***rows;
+	unsigned int i, n = 0;
+	int c;
+
+	groups = malloc((group_count + 1) * sizeof(*groups));
+	rows = calloc(group_count + 1, sizeof(*rows));
+	if (!groups || !rows) {
+		fprintf(stderr, "ss: failed to malloc buffer\n");
+		abort();
+	}
+	for (i = 0; group_hash && i < 1U << group_hash_bits; i++)
+		for (g = group_hash[i]; g; g = g->next)
+			groups[n++] = g;
+	qsort(groups, n, sizeof(*groups), group_cmp);
+
+	/* format everything first to size the columns */
+	for (c = 0; c < ncols; c++)
+		width[c] = !show_header ? 0 :
+			   strlen(c < group_nfields ?
+				  group_fields[group_by[c]].header :
+				  sums[c - group_nfields]);
+
+	for (i = 0; i < n; i++) {
+		unsigned long long tcpinfo;
+
+		g = groups[i];
+		tcpinfo = g->tcpinfo ? : 1;
+		rows[i] = calloc(ncols, sizeof(char *));
+		if (!rows[i]) {
+			fprintf(stderr, "ss: failed to malloc buffer\n");
+			abort();
+		}
+		for (c = 0; c < group_nfields; c++)
+			rows[i][c] = group_field_text(g, group_by[c]);
+
+		c = group_nfields;
+		if (asprintf(&rows[i][c++], "%llu", g->count) < 0 ||
+		    asprintf(&rows[i][c++], "%llu", g->rq) < 0 ||
+		    asprintf(&rows[i][c++], "%llu", g->wq) < 0)
+			abort();
+		if (show_tcpinfo &&
+		    (asprintf(&rows[i][c++], "%llu", g->unacked) < 0 ||
+		     asprintf(&rows[i][c++], "%llu", g->retrans) < 0 ||
+		     asprintf(&rows[i][c++], "%llu", g->lost) < 0 ||
+		     asprintf(&rows[i][c++], "%llu", g->bytes_acked) < 0 ||
+		     asprintf(&rows[i][c++], "%llu", g->bytes_received) < 0 ||
+		     asprintf(&rows[i][c++], "%.3f",
+			      (double)g->rtt / tcpinfo / 1000) < 0))
+			abort();
+
+		for (c = 0; c < ncols; c++)
+			if (rows[i][c] && strlen(rows[i][c]) > width[c])
+				width[c] = strlen(rows[i][c]);
+	}
+
+	if (show_header) {
+		for (c = 0; c < ncols; c++)
+			printf("%s%-*s", c ? " " : "",
+			       c < ncols - 1 ? width[c] : 0,
+			       c < group_nfields ?
+			       group_fields[group_by[c]].header :
+			       sums[c - group_nfields]);
+		printf("\n");
+	}
+
+	for (i = 0; i < n; i++) {
+		for (c = 0; c < ncols; c++) {
+			const char *text = rows[i][c] ? : "";
+
+			if (c < group_nfields)
+				printf("%s%-*s", c ? " " : "",
+				       c < ncols - 1 ? width[c] : 0, text);
+			else
+				printf(" %*s", width[c], text);
+			free(rows[i][c]);
+		}
+		printf("\n");
+		free(rows[i]);
+	}
+
+	for (i = 0; i < n; i++)
+		free(groups[i]);
+	free(groups);
+	free(rows);
+	free(group_hash);
+	group_hash = NULL;
+	group_hash_bits = group_count = 0;
 }
 
 static int tcp_show_line(char *line, const struct filter *f, int family)
@@ -2651,6 +3528,11 @@ static int tcp_show_line(char *line, const struct filter *f, int family)
 	s.rto	    = s.rto != 3 * hz  ? s.rto / hz : 0;
 	s.ss.type   = IPPROTO_TCP;
 
+	if (group_nfields) {
+		group_add(&s.ss, NULL);
+		return 0;
+	}
+
 	inet_stats_print(&s.ss, false);
 
 	if (show_options)
@@ -2999,6 +3881,36 @@ static void parse_diag_msg(struct nlmsghdr *nlh, struct sockstat *s)
 	memcpy(s->remote.data, r->id.idiag_dst, s->local.bytelen);
 }
 
+/* --json-lines: one object per socket, instead of the columns */
+static void inet_sock_json(const struct sockstat *s)
+{
+	int len = s->local.family == AF_INET ? 4 : 16;
+
+	open_json_object(NULL);
+	print_string(PRINT_JSON, "netid", NULL, proto_name(s->type));
+	print_string(PRINT_JSON, "state", NULL, sstate_name[s->state]);
+	print_int(PRINT_JSON, "recv_q", NULL, s->rq);
+	print_int(PRINT_JSON, "send_q", NULL, s->wq);
+	print_string(PRINT_JSON, "local", NULL,
+		     format_host(s->local.family, len, s->local.data));
+	print_int(PRINT_JSON, "lport", NULL, s->lport);
+	if (s->iface)
+		print_string(PRINT_JSON, "dev", NULL,
+			     ll_index_to_name(s->iface));
+	print_string(PRINT_JSON, "peer", NULL,
+		     format_host(s->remote.family, len, s->remote.data));
+	print_int(PRINT_JSON, "pport", NULL, s->rport);
+
+	if (show_details) {
+		print_uint(PRINT_JSON, "uid", NULL, s->uid);
+		print_uint(PRINT_JSON, "ino", NULL, s->ino);
+		print_0xhex(PRINT_JSON, "sk", NULL, s->sk);
+		if (s->mark)
+			print_0xhex(PRINT_JSON, "fwmark", NULL, s->mark);
+	}
+	close_json_object();
+}
+
 static int inet_show_sock(struct nlmsghdr *nlh,
 			  struct sockstat *s)
 {
@@ -3015,6 +3927,27 @@ static int inet_show_sock(struct nlmsghdr *nlh,
 	if (s->local.family == AF_INET6 && tb[INET_DIAG_SKV6ONLY])
 		v6only = rta_getattr_u8(tb[INET_DIAG_SKV6ONLY]);
 
+	if (is_json_context()) {
+		inet_sock_json(s);
+		return 0;
+	}
+
+	if (group_nfields) {
+		struct tcp_info *info = NULL;
+
+		if (s->type == IPPROTO_TCP && tb[INET_DIAG_INFO]) {
+			int len = RTA_PAYLOAD(tb[INET_DIAG_INFO]);
+
+			/* older kernels have less fields */
+			info = alloca(sizeof(*info));
+			memset(info, 0, sizeof(*info));
+			memcpy(info, RTA_DATA(tb[INET_DIAG_INFO]),
+			       min(len, (int)sizeof(*info)));
+		}
+		group_add(s, info);
+		return 0;
+	}
+
 	inet_stats_print(s, v6only);
 
 	if (show_options) {
@@ -3209,11 +4142,36 @@ struct inet_diag_arg {
 	struct rtnl_handle *rth;
 };
 
+/* SOCK_DESTROY requests in flight on the killing socket; one more slot,
+ * as a request is stored before sending it makes room in the window
+ */
+#define KILL_WINDOW	256
+#define KILL_SLOTS	(KILL_WINDOW + 1)
+
+/* Dump messages of the sockets being killed, shown once that succeeded */
+struct kill_slot {
+	struct nlmsghdr	*h;
+	size_t		size;
+};
+
+static struct {
+	struct kill_slot slot[KILL_SLOTS];
+	int		tag;
+	unsigned int	killed;
+	unsigned int	gone;		/* already closed */
+	unsigned int	unsupported;
+	unsigned int	failed;
+	int		error;		/* first real failure, stops the dump */
+	struct timespec	start;
+} kills;
+
 static int kill_inet_sock(struct nlmsghdr *h, void *arg, struct sockstat *s)
 {
 	struct inet_diag_msg *d = NLMSG_DATA(h);
 	struct inet_diag_arg *diag_arg = arg;
 	struct rtnl_handle *rth = diag_arg->rth;
+	struct kill_slot *slot;
+	int err;
 
 	DIAG_REQUEST(req, struct inet_diag_req_v2 r);
 
@@ -3231,7 +4189,88 @@ static int kill_inet_sock(struct nlmsghdr *h, void *arg, struct sockstat *s)
 		raw->sdiag_raw_protocol = s->raw_prot;
 	}
 
-	return rtnl_talk(rth, &req.nlh, NULL);
+	if (!rth->pipe)
+		return rtnl_talk(rth, &req.nlh, NULL);
+
+	/* Up to KILL_WINDOW requests are still in flight here, the one which
+	 * used this slot before is not among them.
+	 */
+	slot = &kills.slot[kills.tag % KILL_SLOTS];
+	if (slot->size < h->nlmsg_len) {
+		free(slot->h);
+		slot->h = malloc(h->nlmsg_len);
+		if (!slot->h) {
+			fprintf(stderr, "ss: failed to malloc buffer\n");
+			abort();
+		}
+		slot->size = h->nlmsg_len;
+	}
+	memcpy(slot->h, h, h->nlmsg_len);
+
+	rtnl_pipeline_begin(rth, kills.tag++);
+	err = rtnl_talk(rth, &req.nlh, NULL);
+	rtnl_pipeline_end(rth);
+	if (err < 0)
+		return err;
+
+	/* shown by kill_inet_ack() */
+	return 1;
+}
+
+static int kill_inet_ack(int tag, int error, const struct nlmsghdr *n,
+			 void *arg)
+{
+	struct nlmsghdr *h = kills.slot[tag % KILL_SLOTS].h;
+	struct inet_diag_arg *diag_arg = arg;
+	struct sockstat s = {};
+
+	/* not the ACK itself */
+	if (!error && n && n->nlmsg_type != NLMSG_ERROR)
+		return 0;
+
+	switch (error) {
+	case 0:
+		kills.killed++;
+		parse_diag_msg(h, &s);
+		s.type = diag_arg->protocol;
+		inet_show_sock(h, &s);
+		break;
+	case -ENOENT:
+		kills.gone++;
+		break;
+	case -EOPNOTSUPP:
+		kills.unsupported++;
+		break;
+	default:
+		kills.failed++;
+		if (!kills.error) {
+			fprintf(stderr, "SOCK_DESTROY answers: %s\n",
+				strerror(-error));
+			kills.error = error;
+		}
+	}
+	return 0;
+}
+
+static void kill_summary(void)
+{
+	struct timespec now;
+	double secs;
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	secs = now.tv_sec - kills.start.tv_sec +
+	       (now.tv_nsec - kills.start.tv_nsec) / 1e9;
+
+	fprintf(stderr, "Killed %u sockets in %.3fs (%.0f/s)",
+		kills.killed, secs, secs > 0 ? kills.killed / secs : 0.);
+	if (kills.gone)
+		fprintf(stderr, ", %u already closed", kills.gone);
+	if (kills.unsupported)
+		fprintf(stderr, ", %u not supported", kills.unsupported);
+	if (kills.failed)
+		fprintf(stderr, ", %u failed", kills.failed);
+	fprintf(stderr, "\n");
 }
 
 static int show_one_inet_sock(struct nlmsghdr *h, void *arg)
@@ -3250,13 +4289,20 @@ static int show_one_inet_sock(struct nlmsghdr *h, void *arg)
 	if (diag_arg->f->f && run_ssfilter(diag_arg->f->f, &s) == 0)
 		return 0;
 
-	if (diag_arg->f->kill && kill_inet_sock(h, arg, &s) != 0) {
-		if (errno == EOPNOTSUPP || errno == ENOENT) {
-			/* Socket can't be closed, or is already closed. */
-			return 0;
-		} else {
-			perror("SOCK_DESTROY answers");
+	if (diag_arg->f->kill) {
+		err = kill_inet_sock(h, arg, &s);
+		if (kills.error)
 			return -1;
+		if (err > 0)
+			return 0;
+		if (err != 0) {
+			if (errno == EOPNOTSUPP || errno == ENOENT) {
+				/* Socket can't be closed, or is already closed. */
+				return 0;
+			} else {
+				perror("SOCK_DESTROY answers");
+				return -1;
+			}
 		}
 	}
 
@@ -3267,6 +4313,157 @@ static int show_one_inet_sock(struct nlmsghdr *h, void *arg)
 	return 0;
 }
 
+/* Have the names of a batch of sockets looked up while it is shown */
+static void inet_diag_prefetch(const struct nlmsghdr *h)
+{
+	const struct inet_diag_msg *r = NLMSG_DATA(h);
+	int len;
+
+	if (h->nlmsg_len < NLMSG_LENGTH(sizeof(*r)))
+		return;
+
+	len = r->idiag_family == AF_INET ? 4 : 16;
+	resolve_prefetch(r->idiag_family, len, r->id.idiag_src);
+	resolve_prefetch(r->idiag_family, len, r->id.idiag_dst);
+}
+
+/* --parallel: the dumps are taken on worker threads, each into a buffer of
+ * its own, and then shown from there in the usual order.
+ */
+#define DUMP_JOBS_MAX	16
+
+struct dump_job {
+	struct filter	f;
+	int		(*dump)(struct filter *f);
+	rtnl_filter_t	show;
+	int		family;		/* inet dumps, one job per family */
+	int		protocol;
+	pthread_t	thread;
+	bool		started;
+	bool		joined;
+	bool		used;
+	int		err;
+	char		*buf;
+	size_t		len;
+};
+
+static int parallel_dumps;
+static struct dump_job dump_jobs[DUMP_JOBS_MAX];
+static int dump_njobs;
+
+static int inet_dump_capture(struct dump_job *job)
+{
+	struct rtnl_handle rth;
+	int err;
+
+	if (rtnl_open_byproto(&rth, 0, NETLINK_SOCK_DIAG))
+		return -1;
+
+	rth.dump = MAGIC_SEQ;
+	rth.dump_fp = job->f.dump_fp;
+
+	err = sockdiag_send(job->family, rth.fd, job->protocol, &job->f);
+	if (!err)
+		err = rtnl_dump_filter(&rth, show_one_inet_sock, NULL);
+
+	rtnl_close(&rth);
+	return err;
+}
+
+static void *dump_job_run(void *arg)
+{
+	struct dump_job *job = arg;
+
+	job->f.dump_fp = open_memstream(&job->buf, &job->len);
+	if (!job->f.dump_fp) {
+		job->err = -1;
+		return NULL;
+	}
+
+	if (job->dump)
+		job->err = job->dump(&job->f);
+	else
+		job->err = inet_dump_capture(job);
+
+	fclose(job->f.dump_fp);
+	job->f.dump_fp = NULL;
+	return NULL;
+}
+
+static int dump_replay_one(struct dump_job *job, rtnl_filter_t show,
+			   void *arg, void (*prefetch)(const struct nlmsghdr *))
+{
+	struct nlmsghdr *h = (struct nlmsghdr *)job->buf, *p = h;
+	int len = job->len, plen = job->len;
+
+	while (NLMSG_OK(h, len)) {
+		int err, n;
+
+		/* have names looked up a batch ahead, as a live dump does */
+		for (n = 0; prefetch && p == h && n < 256 && NLMSG_OK(p, plen);
+		     n++, p = NLMSG_NEXT(p, plen))
+			if (p->nlmsg_type >= NLMSG_MIN_TYPE)
+				prefetch(p);
+
+		if (h->nlmsg_type >= NLMSG_MIN_TYPE) {
+			err = show(h, arg);
+			if (err < 0)
+				return err;
+		}
+		h = NLMSG_NEXT(h, len);
+	}
+	return 0;
+}
+
+/* Show what the workers dumped for show and protocol.  Returns -1 if there
+ * is no such dump, or if one of them failed, so that it is done again the
+ * usual way.
+ */
+static int dump_replay(rtnl_filter_t show, int protocol, void *arg,
+		       void (*prefetch)(const struct nlmsghdr *))
+{
+	int i, found = 0, err = 0;
+
+	for (i = 0; i < dump_njobs; i++) {
+		struct dump_job *job = &dump_jobs[i];
+
+		if (job->show != show || job->protocol != protocol ||
+		    !job->started || job->used)
+			continue;
+
+		if (!job->joined) {
+			pthread_join(job->thread, NULL);
+			job->joined = true;
+		}
+		if (job->err)
+			err = -1;
+		found++;
+	}
+	if (!found || err)
+		goto out;
+
+	for (i = 0; i < dump_njobs && !err; i++) {
+		struct dump_job *job = &dump_jobs[i];
+
+		if (job->show == show && job->protocol == protocol &&
+		    job->started && !job->used)
+			err = dump_replay_one(job, show, arg, prefetch);
+	}
+
+out:
+	for (i = 0; i < dump_njobs; i++) {
+		struct dump_job *job = &dump_jobs[i];
+
+		if (job->show == show && job->protocol == protocol &&
+		    job->joined) {
+			free(job->buf);
+			job->buf = NULL;
+			job->used = true;
+		}
+	}
+	return found ? err : -1;
+}
+
 static int inet_show_netlink(struct filter *f, FILE *dump_fp, int protocol)
 {
 	int err = 0;
@@ -3274,6 +4471,11 @@ static int inet_show_netlink(struct filter *f, FILE *dump_fp, int protocol)
 	int family = PF_INET;
 	struct inet_diag_arg arg = { .f = f, .protocol = protocol };
 
+	if (!dump_fp && !f->kill &&
+	    dump_replay(show_one_inet_sock, protocol, &arg,
+			resolve_hosts ? inet_diag_prefetch : NULL) == 0)
+		return 0;
+
 	if (rtnl_open_byproto(&rth, 0, NETLINK_SOCK_DIAG))
 		return -1;
 
@@ -3283,10 +4485,17 @@ static int inet_show_netlink(struct filter *f, FILE *dump_fp, int protocol)
 			return -1;
 		}
 		arg.rth = &rth2;
+		if (rtnl_pipeline_init(&rth2, KILL_WINDOW, kill_inet_ack,
+				       &arg) < 0) {
+			err = -1;
+			goto Exit;
+		}
 	}
 
 	rth.dump = MAGIC_SEQ;
 	rth.dump_fp = dump_fp;
+	if (resolve_hosts)
+		rth.prefetch = inet_diag_prefetch;
 	if (preferred_family == PF_INET6)
 		family = PF_INET6;
 
@@ -3308,8 +4517,11 @@ again:
 
 Exit:
 	rtnl_close(&rth);
-	if (arg.rth)
+	if (arg.rth) {
+		/* failures are counted, don't fall back to /proc for them */
+		rtnl_pipeline_drain(arg.rth);
 		rtnl_close(arg.rth);
+	}
 	return err;
 }
 
@@ -3501,6 +4713,11 @@ static int dgram_show_line(char *line, const struct filter *f, int family)
 		opt[0] = 0;
 
 	s.type = dg_proto == UDP_PROTO ? IPPROTO_UDP : 0;
+	if (group_nfields) {
+		group_add(&s, NULL);
+		return 0;
+	}
+
 	inet_stats_print(&s, false);
 
 	if (show_details && opt[0])
@@ -3708,10 +4925,14 @@ static int handle_netlink_request(struct filter *f, struct nlmsghdr *req,
 	int ret = -1;
 	struct rtnl_handle rth;
 
+	if (!f->dump_fp && dump_replay(show_one_sock, 0, f, NULL) == 0)
+		return 0;
+
 	if (rtnl_open_byproto(&rth, 0, NETLINK_SOCK_DIAG))
 		return -1;
 
 	rth.dump = MAGIC_SEQ;
+	rth.dump_fp = f->dump_fp;
 
 	if (rtnl_send(&rth, req, size) < 0)
 		goto Exit;
@@ -4604,6 +5825,74 @@ static int tipc_show(struct filter *f)
 	return handle_netlink_request(f, &req.nlh, sizeof(req), tipc_show_sock);
 }
 
+static void dump_job_add(struct filter *f, int (*dump)(struct filter *f),
+			 rtnl_filter_t show, int family, int protocol)
+{
+	struct dump_job *job = &dump_jobs[dump_njobs];
+
+	if (dump_njobs == DUMP_JOBS_MAX)
+		return;
+
+	job->f = *f;
+	job->dump = dump;
+	job->show = show;
+	job->family = family;
+	job->protocol = protocol;
+	if (pthread_create(&job->thread, NULL, dump_job_run, job))
+		return;
+	job->started = true;
+	dump_njobs++;
+}
+
+static void dump_inet_jobs_add(struct filter *f, int protocol)
+{
+	if (!filter_af_get(f, AF_INET) && !filter_af_get(f, AF_INET6))
+		return;
+
+	if (preferred_family != PF_INET6)
+		dump_job_add(f, NULL, show_one_inet_sock, PF_INET, protocol);
+	if (preferred_family != PF_INET)
+		dump_job_add(f, NULL, show_one_inet_sock, PF_INET6, protocol);
+}
+
+/* Start a worker for each dump that main() is going to show next */
+static void dump_start(struct filter *f)
+{
+	if (f->dbs & PACKET_DBM)
+		dump_job_add(f, packet_show_netlink, packet_show_sock, 0, 0);
+	if (f->dbs & UNIX_DBM)
+		dump_job_add(f, unix_show_netlink, unix_show_sock, 0, 0);
+	if (f->dbs & (1<<RAW_DB))
+		dump_inet_jobs_add(f, IPPROTO_RAW);
+	if (f->dbs & (1<<UDP_DB))
+		dump_inet_jobs_add(f, IPPROTO_UDP);
+	if (f->dbs & (1<<TCP_DB))
+		dump_inet_jobs_add(f, IPPROTO_TCP);
+	if (f->dbs & (1<<DCCP_DB))
+		dump_inet_jobs_add(f, IPPROTO_DCCP);
+	if (f->dbs & (1<<SCTP_DB))
+		dump_inet_jobs_add(f, IPPROTO_SCTP);
+	if (f->dbs & VSOCK_DBM)
+		dump_job_add(f, vsock_show, vsock_show_sock, 0, 0);
+	if (f->dbs & (1<<TIPC_DB))
+		dump_job_add(f, tipc_show, tipc_show_sock, 0, 0);
+	if (f->dbs & (1<<XDP_DB))
+		dump_job_add(f, xdp_show, xdp_show_sock, 0, 0);
+}
+
+/* Wait for the dumps that were not shown and drop them */
+static void dump_stop(void)
+{
+	int i;
+
+	for (i = 0; i < dump_njobs; i++) {
+		if (!dump_jobs[i].joined)
+			pthread_join(dump_jobs[i].thread, NULL);
+		free(dump_jobs[i].buf);
+	}
+	dump_njobs = 0;
+}
+
 struct sock_diag_msg {
 	__u8 sdiag_family;
 };
@@ -4639,7 +5928,7 @@ static int generic_show_sock(struct nlmsghdr *nlh, void *arg)
 		ret = -1;
 	}
 
-	render();
+	render(false);
 
 	return ret;
 }
@@ -4676,9 +5965,14 @@ static int handle_follow_request(struct filter *f)
 		f->rth_for_killing = &rth2;
 	}
 
+	new_json_obj(json_lines);
+	rth.idle = fflush_fp;
+
 	if (rtnl_dump_filter(&rth, generic_show_sock, f))
 		ret = -1;
 
+	delete_json_obj();
+
 	rtnl_close(&rth);
 	if (f->rth_for_killing)
 		rtnl_close(f->rth_for_killing);
@@ -4851,12 +6145,18 @@ static void _usage(FILE *dest)
 "   -e, --extended      show detailed socket information\n"
 "   -m, --memory        show socket memory usage\n"
 "   -p, --processes     show process using socket\n"
+"       --first-owner   with -p, -Z or -z, show one process per socket\n"
+"       --parallel      take the socket dumps concurrently\n"
+"       --stream[=ROWS] print rows right away, size columns by the first ROWS\n"
+"       --group-by=KEYS count inet sockets per netid,state,src[/N],dst[/N],\n"
+"                       sport,dport instead of showing them\n"
 "   -i, --info          show internal TCP information\n"
 "       --tipcinfo      show internal tipc socket information\n"
 "   -s, --summary       show socket usage summary\n"
 "       --tos           show tos and priority information\n"
 "   -b, --bpf           show bpf filter socket information\n"
 "   -E, --events        continually display sockets as they are destroyed\n"
+"       --json-lines    display events as one JSON object per line\n"
 "   -Z, --context       display process SELinux security contexts\n"
 "   -z, --contexts      display process and socket SELinux security contexts\n"
 "   -N, --net           switch to the specified network namespace name\n"
@@ -4964,6 +6264,16 @@ static int scan_state(const char *state)
 /* Values of 'x' are already used so a non-character is used */
 #define OPT_XDPSOCK 260
 
+#define OPT_JSON_LINES 261
+
+#define OPT_FIRST_OWNER 262
+
+#define OPT_PARALLEL 263
+
+#define OPT_STREAM 264
+
+#define OPT_GROUP_BY 265
+
 static const struct option long_opts[] = {
 	{ "numeric", 0, 0, 'n' },
 	{ "resolve", 0, 0, 'r' },
@@ -5003,6 +6313,11 @@ static const struct option long_opts[] = {
 	{ "kill", 0, 0, 'K' },
 	{ "no-header", 0, 0, 'H' },
 	{ "xdp", 0, 0, OPT_XDPSOCK},
+	{ "json-lines", 0, 0, OPT_JSON_LINES },
+	{ "first-owner", 0, 0, OPT_FIRST_OWNER },
+	{ "parallel", 0, 0, OPT_PARALLEL },
+	{ "stream", 2, 0, OPT_STREAM },
+	{ "group-by", 1, 0, OPT_GROUP_BY },
 	{ 0 }
 
 };
@@ -5014,6 +6329,7 @@ int main(int argc, char *argv[])
 	int do_summary = 0;
 	const char *dump_tcpdiag = NULL;
 	FILE *filter_fp = NULL;
+	unsigned int rows;
 	int ch;
 	int state_filter = 0;
 
@@ -5042,7 +6358,6 @@ int main(int argc, char *argv[])
 			break;
 		case 'p':
 			show_users++;
-			user_ent_hash_build();
 			break;
 		case 'b':
 			show_options = 1;
@@ -5093,6 +6408,29 @@ int main(int argc, char *argv[])
 		case OPT_XDPSOCK:
 			filter_af_set(&current_filter, AF_XDP);
 			break;
+		case OPT_JSON_LINES:
+			json_lines = 1;
+			break;
+		case OPT_FIRST_OWNER:
+			first_owner = 1;
+			break;
+		case OPT_PARALLEL:
+			parallel_dumps = 1;
+			break;
+		case OPT_STREAM:
+			rows = STREAM_SAMPLE;
+			if (optarg && (get_unsigned(&rows, optarg, 0) ||
+				       rows > INT_MAX)) {
+				fprintf(stderr, "ss: invalid row count \"%s\"\n",
+					optarg);
+				exit(-1);
+			}
+			stream_sample = rows;
+			break;
+		case OPT_GROUP_BY:
+			if (group_by_parse(optarg))
+				exit(-1);
+			break;
 		case 'f':
 			if (strcmp(optarg, "inet") == 0)
 				filter_af_set(&current_filter, AF_INET);
@@ -5174,7 +6512,6 @@ int main(int argc, char *argv[])
 				exit(1);
 			}
 			show_proc_ctx++;
-			user_ent_hash_build();
 			break;
 		case 'N':
 			if (netns_switch(optarg))
@@ -5282,16 +6619,48 @@ int main(int argc, char *argv[])
 	if (!(current_filter.states & (current_filter.states - 1)))
 		columns[COL_STATE].disabled = 1;
 
-	if (show_header)
+	if (json_lines && !follow_events) {
+		fprintf(stderr, "ss: --json-lines only applies to --events\n");
+		exit(-1);
+	}
+
+	if (group_nfields) {
+		if (follow_events) {
+			fprintf(stderr, "ss: --group-by does not apply to --events\n");
+			exit(-1);
+		}
+		current_filter.dbs &= INET_DBM;
+		if (!current_filter.dbs) {
+			fprintf(stderr, "ss: --group-by only counts inet sockets\n");
+			exit(-1);
+		}
+	}
+
+	if (stream_sample >= 0)
+		setvbuf(stdout, NULL, _IOFBF, STREAM_BUF);
+
+	if (show_header && !json_lines && !group_nfields)
 		print_header();
 
 	fflush(stdout);
 
-	if (follow_events)
+	if (follow_events) {
+		/* sockets are gone by the time their events come in */
+		if (show_users || show_proc_ctx || show_sock_ctx) {
+			user_ent_scan(true);
+			user_ent_complete = 1;
+		}
 		exit(handle_follow_request(&current_filter));
+	}
+
+	if (current_filter.kill)
+		clock_gettime(CLOCK_MONOTONIC, &kills.start);
 
 	if (current_filter.dbs & (1<<NETLINK_DB))
 		netlink_show(&current_filter);
+	/* the netlink dump would show the sockets of the workers */
+	if (parallel_dumps && !current_filter.kill && !getenv("PROC_ROOT"))
+		dump_start(&current_filter);
 	if (current_filter.dbs & PACKET_DBM)
 		packet_show(&current_filter);
 	if (current_filter.dbs & UNIX_DBM)
@@ -5313,10 +6682,16 @@ int main(int argc, char *argv[])
 	if (current_filter.dbs & (1<<XDP_DB))
 		xdp_show(&current_filter);
 
+	render(false);
+	if (group_nfields)
+		group_print();
+
+	if (current_filter.kill)
+		kill_summary();
+	dump_stop();
+
 	if (show_users || show_proc_ctx || show_sock_ctx)
 		user_ent_destroy();
 
-	render();
-
 	return 0;
 }
@@ -199,7 +199,7 @@ static void usage(void)
 		"where  OBJECT := { qdisc | class | filter | chain |\n"
 		"                   action | monitor | exec }\n"
 		"       OPTIONS := { -V[ersion] | -s[tatistics] | -d[etails] | -r[aw] |\n"
-		"                    -o[neline] | -j[son] | -p[retty] | -c[olor]\n"
+		"                    -o[neline] | -j[son] | -json-lines | -cbor | -p[retty] | -c[olor]\n"
 		"                    -b[atch] [filename] | -n[etns] name |\n"
 		"                    -nm | -nam[es] | { -cf | -conf } path }\n");
 }
@@ -207,9 +207,9 @@ static void usage(void)
 static int do_cmd(int argc, char **argv, void *buf, size_t buflen)
 {
 	if (matches(*argv, "qdisc") == 0)
-		return do_qdisc(argc-1, argv+1);
+		return do_qdisc(argc-1, argv+1, buf, buflen);
 	if (matches(*argv, "class") == 0)
-		return do_class(argc-1, argv+1);
+		return do_class(argc-1, argv+1, buf, buflen);
 	if (matches(*argv, "filter") == 0)
 		return do_filter(argc-1, argv+1, buf, buflen);
 	if (matches(*argv, "chain") == 0)
@@ -237,6 +237,8 @@ static bool batchsize_enabled(int argc, char *argv[])
 		char *c;
 		char *subc[TC_MAX_SUBC];
 	} table[] = {
+		{ "qdisc", { "add", "delete", "change", "replace", "link", NULL} },
+		{ "class", { "add", "delete", "change", "replace", NULL} },
 		{ "filter", { "add", "delete", "change", "replace", NULL} },
 		{ "actions", { "add", "change", "replace", NULL} },
 		{ NULL },
@@ -262,10 +264,10 @@ static bool batchsize_enabled(int argc, char *argv[])
 
 struct batch_buf {
 	struct batch_buf	*next;
-	char			buf[16420];	/* sizeof (struct nlmsghdr) +
-						   max(sizeof (struct tcmsg) +
-						   sizeof (struct tcamsg)) +
-						   MAX_MSG */
+	int			lineno;
+	char			buf[NLMSG_SPACE(sizeof(struct tcmsg)) +
+				    TCA_BUF_MAX];	/* largest request,
+							   a qdisc one */
 };
 
 static struct batch_buf *get_batch_buf(struct batch_buf **pool,
@@ -277,10 +279,19 @@ static struct batch_buf *get_batch_buf(struct batch_buf **pool,
 	if (*pool == NULL)
 		buf = calloc(1, sizeof(struct batch_buf));
 	else {
+		struct nlmsghdr *n;
+
 		buf = *pool;
 		*pool = (*pool)->next;
-		memset(buf, 0, sizeof(struct batch_buf));
+		/* only the previous message may have dirtied it */
+		n = (struct nlmsghdr *)buf->buf;
+		memset(buf->buf, 0, MIN(NLMSG_ALIGN(n->nlmsg_len),
+					sizeof(buf->buf)));
+		buf->next = NULL;
+		buf->lineno = 0;
 	}
+	if (!buf)
+		return NULL;
 
 	if (*head == NULL)
 		*head = *tail = buf;
@@ -320,6 +331,52 @@ static void free_batch_bufs(struct batch_buf **pool)
 	*pool = NULL;
 }
 
+static int batch_sndbuf;
+
+struct batch_ack {
+	const char	*name;
+	int		*lines;
+};
+
+/* Name the line of each command the kernel refused */
+static int batch_ack(int tag, int error, const struct nlmsghdr *n, void *arg)
+{
+	struct batch_ack *ack = arg;
+
+	if (error)
+		fprintf(stderr, "Command failed %s:%d\n", ack->name,
+			ack->lines[tag - 1]);
+	return 0;
+}
+
+/* Send the batch in as few writes as the socket send buffer allows */
+static int batch_send(struct iovec *iovs, int *lines, int iovlen,
+		      const char *name)
+{
+	struct batch_ack ack = { .name = name };
+	int ret = 0;
+	int i, cnt;
+
+	for (i = 0; i < iovlen; i += cnt) {
+		size_t len = 0;
+
+		for (cnt = 0; i + cnt < iovlen; cnt++) {
+			if (cnt && len + iovs[i + cnt].iov_len > batch_sndbuf - 32)
+				break;
+			len += iovs[i + cnt].iov_len;
+		}
+
+		ack.lines = lines + i;
+		if (rtnl_talk_iov_ack(&rth, iovs + i, cnt, batch_ack, &ack) < 0) {
+			ret = -1;
+			if (!force)
+				break;
+		}
+	}
+
+	return ret;
+}
+
 static int batch(const char *name)
 {
 	struct batch_buf *head = NULL, *tail = NULL, *buf_pool = NULL;
@@ -327,8 +384,11 @@ static int batch(const char *name)
 	char *line, *line_next = NULL;
 	bool bs_enabled = false;
 	bool lastline = false;
+	bool stop = false;
 	int largc, largc_next;
+	int lineno, lineno_next;
 	bool bs_enabled_saved;
+	socklen_t optlen;
 	bool bs_enabled_next;
 	int batchsize = 0;
 	size_t len = 0;
@@ -352,15 +412,27 @@ static int batch(const char *name)
 		fprintf(stderr, "Cannot open rtnetlink\n");
 		return -1;
 	}
+	/* room for a full batch of class requests, if allowed */
+	batch_sndbuf = MSG_IOV_MAX * 4096;
+	optlen = sizeof(batch_sndbuf);
+	if (setsockopt(rth.fd, SOL_SOCKET, SO_SNDBUF,
+		       &batch_sndbuf, sizeof(batch_sndbuf)) < 0 ||
+	    getsockopt(rth.fd, SOL_SOCKET, SO_SNDBUF,
+		       &batch_sndbuf, &optlen) < 0)
+		batch_sndbuf = 32768;
 
 	cmdlineno = 0;
 	if (getcmdline(&line, &len, stdin) == -1)
 		goto Exit;
+	lineno = cmdlineno;
 	largc = makeargs(line, largv, 100);
 	bs_enabled = batchsize_enabled(largc, largv);
 	do {
+		int cur = lineno;
+
 		if (getcmdline(&line_next, &len, stdin) == -1)
 			lastline = true;
+		lineno_next = cmdlineno;
 
 		largc_next = makeargs(line_next, largv_next, 100);
 		bs_enabled_next = batchsize_enabled(largc_next, largv_next);
@@ -393,6 +465,7 @@ static int batch(const char *name)
 		len = 0;
 		bs_enabled_saved = bs_enabled;
 		bs_enabled = bs_enabled_next;
+		lineno = lineno_next;
 
 		if (largc == 0) {
 			largc = largc_next;
@@ -400,43 +473,58 @@ static int batch(const char *name)
 			continue;	/* blank line */
 		}
 
-		err = do_cmd(largc, largv, tail == NULL ? NULL : tail->buf,
-			     tail == NULL ? 0 : sizeof(tail->buf));
+		err = do_cmd(largc, largv,
+			     bs_enabled_saved ? tail->buf : NULL,
+			     bs_enabled_saved ? sizeof(tail->buf) : 0);
 		fflush(stdout);
 		if (err != 0) {
-			fprintf(stderr, "Command failed %s:%d\n", name,
-				cmdlineno - 1);
+			fprintf(stderr, "Command failed %s:%d\n", name, cur);
 			ret = 1;
+			/* still run what was queued before it */
 			if (!force)
-				break;
+				stop = true;
+		} else if (bs_enabled_saved) {
+			tail->lineno = cur;
 		}
 		largc = largc_next;
 		memcpy(largv, largv_next, largc * sizeof(char *));
 
-		if (send && bs_enabled_saved) {
+		if ((send || stop) && bs_enabled_saved) {
 			struct iovec *iov, *iovs;
 			struct batch_buf *buf;
-			struct nlmsghdr *n;
+			int *lines;
+			int iovlen = 0;
 
-			iov = iovs = malloc(batchsize * sizeof(struct iovec));
-			for (buf = head; buf != NULL; buf = buf->next, ++iov) {
-				n = (struct nlmsghdr *)&buf->buf;
-				iov->iov_base = n;
-				iov->iov_len = n->nlmsg_len;
+			iovs = malloc(batchsize * sizeof(struct iovec));
+			lines = malloc(batchsize * sizeof(int));
+			if (!iovs || !lines) {
+				fprintf(stderr, "failed to allocate iovec\n");
+				return -1;
+			}
+
+			/* commands that failed to parse have nothing to send */
+			for (buf = head; buf != NULL; buf = buf->next) {
+				if (!buf->lineno)
+					continue;
+				iov = &iovs[iovlen];
+				iov->iov_base = buf->buf;
+				iov->iov_len = ((struct nlmsghdr *)buf->buf)->nlmsg_len;
+				lines[iovlen++] = buf->lineno;
 			}
 
-			err = rtnl_talk_iov(&rth, iovs, batchsize, NULL);
+			err = batch_send(iovs, lines, iovlen, name);
 			put_batch_bufs(&buf_pool, &head, &tail);
+			free(lines);
 			free(iovs);
+			batchsize = 0;
 			if (err < 0) {
-				fprintf(stderr, "Command failed %s:%d\n", name,
-					cmdlineno - (batchsize + err) - 1);
 				ret = 1;
 				if (!force)
 					break;
 			}
-			batchsize = 0;
 		}
+		if (stop)
+			break;
 	} while (!lastline);
 
 	free_batch_bufs(&buf_pool);
@@ -501,6 +589,12 @@ int main(int argc, char **argv)
 			++timestamp_short;
 		} else if (matches(argv[1], "-json") == 0) {
 			++json;
+		} else if (strcmp(argv[1], "-json-lines") == 0) {
+			++json;
+			++json_lines;
+		} else if (strcmp(argv[1], "-cbor") == 0) {
+			++json;
+			++cbor;
 		} else if (matches(argv[1], "-oneline") == 0) {
 			++oneline;
 		} else {
@@ -23,21 +23,31 @@
 #include "utils.h"
 #include "tc_util.h"
 #include "tc_common.h"
-#include "list.h"
 
 struct graph_node {
-	struct hlist_node hlist;
+	struct graph_node *hnext;
+	struct graph_node *next;
+	struct graph_node *parent;
+	struct graph_node *child;
+	struct graph_node *last_child;
+	struct graph_node *sibling;
+	int ifindex;
 	__u32 id;
 	__u32 parent_id;
-	struct graph_node *parent_node;
-	struct graph_node *right_node;
 	void *data;
 	int data_len;
-	int nodes_count;
+	int leaves;
+	__u64 bps;
+	__u64 pps;
+	__u64 sub_bps;
+	__u64 sub_pps;
 };
 
-static struct hlist_head cls_list = {};
-static struct hlist_head root_cls_list = {};
+/* classes in dump order, and a classid (+ ifindex) hash over them */
+static struct graph_node *graph_head, **graph_tail = &graph_head;
+static struct graph_node **graph_hash;
+static unsigned int graph_hash_size;
+static unsigned int graph_count;
 
 static void usage(void);
 
@@ -53,23 +63,37 @@ static void usage(void)
 	fprintf(stderr, "OPTIONS := ... try tc class add <desired QDISC_KIND> help\n");
 }
 
-static int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv)
+struct tc_class_req {
+	struct nlmsghdr		n;
+	struct tcmsg		t;
+	char			buf[4096];
+};
+
+static int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv,
+			   void *buf, size_t buflen)
 {
-	struct {
-		struct nlmsghdr	n;
-		struct tcmsg		t;
-		char			buf[4096];
-	} req = {
-		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg)),
-		.n.nlmsg_flags = NLM_F_REQUEST | flags,
-		.n.nlmsg_type = cmd,
-		.t.tcm_family = AF_UNSPEC,
-	};
+	struct tc_class_req *req, class_req;
 	struct qdisc_util *q = NULL;
 	struct tc_estimator est = {};
 	char  d[IFNAMSIZ] = {};
 	char  k[FILTER_NAMESZ] = {};
 
+	if (buf) {
+		req = buf;
+		if (buflen < sizeof(struct tc_class_req)) {
+			fprintf(stderr, "buffer is too small: %zu\n", buflen);
+			return -1;
+		}
+	} else {
+		memset(&class_req, 0, sizeof(struct tc_class_req));
+		req = &class_req;
+	}
+
+	req->n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+	req->n.nlmsg_flags = NLM_F_REQUEST | flags;
+	req->n.nlmsg_type = cmd;
+	req->t.tcm_family = AF_UNSPEC;
+
 	while (argc > 0) {
 		if (strcmp(*argv, "dev") == 0) {
 			NEXT_ARG();
@@ -80,29 +104,29 @@ static int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv)
 			__u32 handle;
 
 			NEXT_ARG();
-			if (req.t.tcm_handle)
+			if (req->t.tcm_handle)
 				duparg("classid", *argv);
 			if (get_tc_classid(&handle, *argv))
 				invarg("invalid class ID", *argv);
-			req.t.tcm_handle = handle;
+			req->t.tcm_handle = handle;
 		} else if (strcmp(*argv, "handle") == 0) {
 			fprintf(stderr, "Error: try \"classid\" instead of \"handle\"\n");
 			return -1;
 		} else if (strcmp(*argv, "root") == 0) {
-			if (req.t.tcm_parent) {
+			if (req->t.tcm_parent) {
 				fprintf(stderr, "Error: \"root\" is duplicate parent ID.\n");
 				return -1;
 			}
-			req.t.tcm_parent = TC_H_ROOT;
+			req->t.tcm_parent = TC_H_ROOT;
 		} else if (strcmp(*argv, "parent") == 0) {
 			__u32 handle;
 
 			NEXT_ARG();
-			if (req.t.tcm_parent)
+			if (req->t.tcm_parent)
 				duparg("parent", *argv);
 			if (get_tc_classid(&handle, *argv))
 				invarg("invalid parent ID", *argv);
-			req.t.tcm_parent = handle;
+			req->t.tcm_parent = handle;
 		} else if (matches(*argv, "estimator") == 0) {
 			if (parse_estimator(&argc, &argv, &est))
 				return -1;
@@ -119,16 +143,16 @@ static int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv)
 	}
 
 	if (k[0])
-		addattr_l(&req.n, sizeof(req), TCA_KIND, k, strlen(k)+1);
+		addattr_l(&req->n, sizeof(*req), TCA_KIND, k, strlen(k)+1);
 	if (est.ewma_log)
-		addattr_l(&req.n, sizeof(req), TCA_RATE, &est, sizeof(est));
+		addattr_l(&req->n, sizeof(*req), TCA_RATE, &est, sizeof(est));
 
 	if (q) {
 		if (q->parse_copt == NULL) {
 			fprintf(stderr, "Error: Qdisc \"%s\" is classless.\n", k);
 			return 1;
 		}
-		if (q->parse_copt(q, argc, argv, &req.n, d))
+		if (q->parse_copt(q, argc, argv, &req->n, d))
 			return 1;
 	} else {
 		if (argc) {
@@ -142,12 +166,15 @@ static int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv)
 	if (d[0])  {
 		ll_init_map(&rth);
 
-		req.t.tcm_ifindex = ll_name_to_index(d);
-		if (!req.t.tcm_ifindex)
+		req->t.tcm_ifindex = ll_name_to_index(d);
+		if (!req->t.tcm_ifindex)
 			return -nodev(d);
 	}
 
-	if (rtnl_talk(&rth, &req.n, NULL) < 0)
+	if (buf)
+		return 0;
+
+	if (rtnl_talk(&rth, &req->n, NULL) < 0)
 		return 2;
 
 	return 0;
@@ -157,11 +184,94 @@ static int filter_ifindex;
 static __u32 filter_qdisc;
 static __u32 filter_classid;
 
-static void graph_node_add(__u32 parent_id, __u32 id, void *data,
-		int len)
+static unsigned int graph_hashfn(int ifindex, __u32 id)
+{
+	__u32 h = id ^ ((__u32)ifindex << 16) ^ ((__u32)ifindex >> 16);
+
+	h ^= h >> 15;
+	h *= 0x2c1b3c6dU;
+	h ^= h >> 12;
+	return h & (graph_hash_size - 1);
+}
+
+static void graph_hash_grow(void)
+{
+	unsigned int size = graph_hash_size ? graph_hash_size * 2 : 256;
+	struct graph_node *node;
+
+	free(graph_hash);
+	graph_hash = calloc(size, sizeof(*graph_hash));
+	if (!graph_hash) {
+		perror("calloc");
+		exit(1);
+	}
+	graph_hash_size = size;
+
+	for (node = graph_head; node; node = node->next) {
+		unsigned int h = graph_hashfn(node->ifindex, node->id);
+
+		node->hnext = graph_hash[h];
+		graph_hash[h] = node;
+	}
+}
+
+static struct graph_node *graph_node_find(int ifindex, __u32 id)
+{
+	struct graph_node *node;
+
+	for (node = graph_hash[graph_hashfn(ifindex, id)]; node;
+	     node = node->hnext)
+		if (node->id == id && node->ifindex == ifindex)
+			return node;
+	return NULL;
+}
+
+/* Measured rate of a class, from its rate estimator */
+static void graph_node_rate(struct graph_node *node, struct rtattr *tb[])
+{
+	if (tb[TCA_STATS2]) {
+		struct rtattr *tbs[TCA_STATS_MAX + 1];
+
+		parse_rtattr_nested(tbs, TCA_STATS_MAX, tb[TCA_STATS2]);
+		if (tbs[TCA_STATS_RATE_EST64]) {
+			struct gnet_stats_rate_est64 re = {0};
+
+			memcpy(&re, RTA_DATA(tbs[TCA_STATS_RATE_EST64]),
+			       MIN(RTA_PAYLOAD(tbs[TCA_STATS_RATE_EST64]),
+				   sizeof(re)));
+			node->bps = re.bps;
+			node->pps = re.pps;
+		} else if (tbs[TCA_STATS_RATE_EST]) {
+			struct gnet_stats_rate_est re = {0};
+
+			memcpy(&re, RTA_DATA(tbs[TCA_STATS_RATE_EST]),
+			       MIN(RTA_PAYLOAD(tbs[TCA_STATS_RATE_EST]),
+				   sizeof(re)));
+			node->bps = re.bps;
+			node->pps = re.pps;
+		}
+	} else if (tb[TCA_STATS]) {
+		struct tc_stats st = {};
+
+		memcpy(&st, RTA_DATA(tb[TCA_STATS]),
+		       MIN(RTA_PAYLOAD(tb[TCA_STATS]), sizeof(st)));
+		node->bps = st.bps;
+		node->pps = st.pps;
+	}
+}
+
+static void graph_node_add(int ifindex, __u32 parent_id, __u32 id,
+			   void *data, int len)
 {
 	struct graph_node *node = calloc(1, sizeof(struct graph_node));
+	unsigned int h;
 
+	if (!node) {
+		perror("calloc");
+		exit(1);
+	}
+
+	node->ifindex    = ifindex;
 	node->id         = id;
 	node->parent_id  = parent_id;
 
@@ -171,129 +281,212 @@ static void graph_node_add(__u32 parent_id, __u32 id, void *data,
 		memcpy(node->data, data, len);
 	}
 
-	if (parent_id == TC_H_ROOT)
-		hlist_add_head(&node->hlist, &root_cls_list);
-	else
-		hlist_add_head(&node->hlist, &cls_list);
+	*graph_tail = node;
+	graph_tail = &node->next;
+
+	if (++graph_count > graph_hash_size) {
+		graph_hash_grow();
+	} else {
+		h = graph_hashfn(ifindex, id);
+		node->hnext = graph_hash[h];
+		graph_hash[h] = node;
+	}
 }
 
-static void graph_indent(char *buf, struct graph_node *node, int is_newline,
-		int add_spaces)
+/* Link every class below its parent in one pass over the dump and sum up
+ * the rates of the leaves of each subtree.  Children keep dump order,
+ * classes without a (known) parent become roots, most recent first.
+ */
+static struct graph_node *graph_link(void)
 {
-	char spaces[100] = {0};
+	struct graph_node *roots = NULL;
+	struct graph_node *node, *p;
+
+	for (node = graph_head; node; node = node->next) {
+		struct rtattr *tb[TCA_MAX + 1];
+
+		parse_rtattr(tb, TCA_MAX, (struct rtattr *)node->data,
+			     node->data_len);
+		graph_node_rate(node, tb);
+
+		p = NULL;
+		if (node->parent_id != TC_H_ROOT &&
+		    node->parent_id != node->id)
+			p = graph_node_find(node->ifindex, node->parent_id);
 
-	while (node && node->parent_node) {
-		node->parent_node->right_node = node;
-		node = node->parent_node;
+		if (!p) {
+			node->sibling = roots;
+			roots = node;
+		} else {
+			node->parent = p;
+			if (p->last_child)
+				p->last_child->sibling = node;
+			else
+				p->child = node;
+			p->last_child = node;
+		}
 	}
-	while (node && node->right_node) {
-		if (node->hlist.next)
-			strcat(buf, "|    ");
-		else
-			strcat(buf, "     ");
 
-		node = node->right_node;
+	for (node = graph_head; node; node = node->next) {
+		if (node->child)
+			continue;
+		node->leaves = 1;
+		node->sub_bps = node->bps;
+		node->sub_pps = node->pps;
+		for (p = node->parent; p; p = p->parent) {
+			p->leaves++;
+			p->sub_bps += node->bps;
+			p->sub_pps += node->pps;
+		}
 	}
 
-	if (is_newline) {
-		if (node->hlist.next && node->nodes_count)
-			strcat(buf, "|    |");
-		else if (node->hlist.next)
-			strcat(buf, "|     ");
-		else if (node->nodes_count)
-			strcat(buf, "     |");
-		else if (!node->hlist.next)
-			strcat(buf, "      ");
+	return roots;
+}
+
+static void graph_free(void)
+{
+	struct graph_node *node, *next;
+
+	for (node = graph_head; node; node = next) {
+		next = node->next;
+		free(node->data);
+		free(node);
 	}
-	if (add_spaces > 0) {
-		sprintf(spaces, "%-*s", add_spaces, "");
-		strcat(buf, spaces);
+	graph_head = NULL;
+	graph_tail = &graph_head;
+	free(graph_hash);
+	graph_hash = NULL;
+	graph_hash_size = 0;
+	graph_count = 0;
+}
+
+struct graph_prefix {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static void graph_prefix_add(struct graph_prefix *pfx, const char *s, int n)
+{
+	if (pfx->len + n + 1 > pfx->size) {
+		size_t size = pfx->size ? pfx->size * 2 : 256;
+
+		while (size < pfx->len + n + 1)
+			size *= 2;
+		pfx->buf = realloc(pfx->buf, size);
+		if (!pfx->buf) {
+			perror("realloc");
+			exit(1);
+		}
+		pfx->size = size;
 	}
+	memcpy(pfx->buf + pfx->len, s, n);
+	pfx->len += n;
+	pfx->buf[pfx->len] = '\0';
+}
+
+static void graph_prefix_trim(struct graph_prefix *pfx, size_t len)
+{
+	pfx->len = len;
+	pfx->buf[len] = '\0';
+}
+
+/* Extend the ancestors' columns to the prefix of the lines under a class:
+ * its own column, then pad spaces.
+ */
+static void graph_newline(struct graph_prefix *pfx, struct graph_node *node,
+			  int pad)
+{
+	if (node->sibling && node->child)
+		graph_prefix_add(pfx, "|    |", 6);
+	else if (node->sibling)
+		graph_prefix_add(pfx, "|     ", 6);
+	else if (node->child)
+		graph_prefix_add(pfx, "     |", 6);
+	else
+		graph_prefix_add(pfx, "      ", 6);
+	while (pad-- > 0)
+		graph_prefix_add(pfx, " ", 1);
 }
 
-static void graph_cls_show(FILE *fp, char *buf, struct hlist_head *root_list,
-		int level)
+static void graph_cls_print(FILE *fp, struct graph_prefix *pfx,
+			    struct graph_node *cls)
 {
-	struct hlist_node *n, *tmp_cls;
 	char cls_id_str[256] = {};
 	struct rtattr *tb[TCA_MAX + 1];
 	struct qdisc_util *q;
-	char str[300] = {};
-
-	hlist_for_each_safe(n, tmp_cls, root_list) {
-		struct hlist_node *c, *tmp_chld;
-		struct hlist_head children = {};
-		struct graph_node *cls = container_of(n, struct graph_node,
-				hlist);
-
-		hlist_for_each_safe(c, tmp_chld, &cls_list) {
-			struct graph_node *child = container_of(c,
-					struct graph_node, hlist);
-
-			if (cls->id == child->parent_id) {
-				hlist_del(c);
-				hlist_add_head(c, &children);
-				cls->nodes_count++;
-				child->parent_node = cls;
-			}
-		}
+	size_t len = pfx->len;
 
-		graph_indent(buf, cls, 0, 0);
+	print_tc_classid(cls_id_str, sizeof(cls_id_str), cls->id);
+	fprintf(fp, "%s+---(%s)", pfx->buf, cls_id_str);
 
-		print_tc_classid(cls_id_str, sizeof(cls_id_str), cls->id);
-		snprintf(str, sizeof(str),
-			 "+---(%s)", cls_id_str);
-		strcat(buf, str);
+	parse_rtattr(tb, TCA_MAX, (struct rtattr *)cls->data, cls->data_len);
 
-		parse_rtattr(tb, TCA_MAX, (struct rtattr *)cls->data,
-				cls->data_len);
+	if (tb[TCA_KIND] == NULL) {
+		fprintf(fp, " [unknown qdisc kind] \n");
+		return;
+	}
 
-		if (tb[TCA_KIND] == NULL) {
-			strcat(buf, " [unknown qdisc kind] ");
-		} else {
-			const char *kind = rta_getattr_str(tb[TCA_KIND]);
+	fprintf(fp, " %s ", rta_getattr_str(tb[TCA_KIND]));
 
-			sprintf(str, " %s ", kind);
-			strcat(buf, str);
-			fprintf(fp, "%s", buf);
-			buf[0] = '\0';
+	q = get_qdisc_kind(rta_getattr_str(tb[TCA_KIND]));
+	if (q && q->print_copt)
+		q->print_copt(q, fp, tb[TCA_OPTIONS]);
+	if (q && show_stats) {
+		int cls_indent = strlen(q->id) - 2 + strlen(cls_id_str);
+		struct rtattr *stats = NULL;
+		SPRINT_BUF(b1);
 
-			q = get_qdisc_kind(kind);
-			if (q && q->print_copt) {
-				q->print_copt(q, fp, tb[TCA_OPTIONS]);
-			}
-			if (q && show_stats) {
-				int cls_indent = strlen(q->id) - 2 +
-					strlen(cls_id_str);
-				struct rtattr *stats = NULL;
-
-				graph_indent(buf, cls, 1, cls_indent);
-
-				if (tb[TCA_STATS] || tb[TCA_STATS2]) {
-					fprintf(fp, "\n");
-					print_tcstats_attr(fp, tb, buf, &stats);
-					buf[0] = '\0';
-				}
-				if (cls->hlist.next || cls->nodes_count) {
-					strcat(buf, "\n");
-					graph_indent(buf, cls, 1, 0);
-				}
-			}
+		graph_newline(pfx, cls, cls_indent);
+		if (tb[TCA_STATS] || tb[TCA_STATS2]) {
+			fprintf(fp, "\n");
+			print_tcstats_attr(fp, tb, pfx->buf, &stats);
 		}
-		free(cls->data);
-		fprintf(fp, "%s\n", buf);
-		buf[0] = '\0';
-
-		graph_cls_show(fp, buf, &children, level + 1);
-		if (!cls->hlist.next) {
-			graph_indent(buf, cls, 0, 0);
-			strcat(buf, "\n");
+		if (cls->child)
+			fprintf(fp, "\n%ssubtree rate %s %llupps leaves %d",
+				pfx->buf, sprint_rate(cls->sub_bps, b1),
+				(unsigned long long)cls->sub_pps, cls->leaves);
+		graph_prefix_trim(pfx, len);
+
+		if (cls->sibling || cls->child) {
+			graph_newline(pfx, cls, 0);
+			fprintf(fp, "\n%s", pfx->buf);
+			graph_prefix_trim(pfx, len);
 		}
+	}
+	fprintf(fp, "\n");
+}
 
-		fprintf(fp, "%s", buf);
-		buf[0] = '\0';
-		free(cls);
+/* Walk the tree depth first without recursion; the prefix holds one
+ * column per ancestor.
+ */
+static void graph_cls_show(FILE *fp)
+{
+	struct graph_prefix pfx = {};
+	struct graph_node *cls = graph_link();
+
+	graph_prefix_add(&pfx, "", 0);
+	while (cls) {
+		graph_cls_print(fp, &pfx, cls);
+		if (cls->child) {
+			graph_prefix_add(&pfx, cls->sibling ? "|    " : "     ", 5);
+			cls = cls->child;
+			continue;
+		}
+		while (cls) {
+			if (cls->sibling) {
+				cls = cls->sibling;
+				break;
+			}
+			fprintf(fp, "%s\n", pfx.buf);
+			cls = cls->parent;
+			if (cls)
+				graph_prefix_trim(&pfx, pfx.len - 5);
+		}
 	}
+
+	free(pfx.buf);
+	graph_free();
 }
 
 int print_class(struct nlmsghdr *n, void *arg)
@@ -316,7 +509,8 @@ int print_class(struct nlmsghdr *n, void *arg)
 	}
 
 	if (show_graph) {
-		graph_node_add(t->tcm_parent, t->tcm_handle, TCA_RTA(t), len);
+		graph_node_add(t->tcm_ifindex, t->tcm_parent, t->tcm_handle,
+			       TCA_RTA(t), len);
 		return 0;
 	}
 
@@ -388,7 +582,6 @@ static int tc_class_list(int argc, char **argv)
 {
 	struct tcmsg t = { .tcm_family = AF_UNSPEC };
 	char d[IFNAMSIZ] = {};
-	char buf[1024] = {0};
 
 	filter_qdisc = 0;
 	filter_classid = 0;
@@ -456,23 +649,27 @@ static int tc_class_list(int argc, char **argv)
 	}
 
 	if (show_graph)
-		graph_cls_show(stdout, &buf[0], &root_cls_list, 0);
+		graph_cls_show(stdout);
 
 	return 0;
 }
 
-int do_class(int argc, char **argv)
+int do_class(int argc, char **argv, void *buf, size_t buflen)
 {
 	if (argc < 1)
 		return tc_class_list(0, NULL);
 	if (matches(*argv, "add") == 0)
-		return tc_class_modify(RTM_NEWTCLASS, NLM_F_EXCL|NLM_F_CREATE, argc-1, argv+1);
+		return tc_class_modify(RTM_NEWTCLASS, NLM_F_EXCL|NLM_F_CREATE,
+				       argc-1, argv+1, buf, buflen);
 	if (matches(*argv, "change") == 0)
-		return tc_class_modify(RTM_NEWTCLASS, 0, argc-1, argv+1);
+		return tc_class_modify(RTM_NEWTCLASS, 0, argc-1, argv+1,
+				       buf, buflen);
 	if (matches(*argv, "replace") == 0)
-		return tc_class_modify(RTM_NEWTCLASS, NLM_F_CREATE, argc-1, argv+1);
+		return tc_class_modify(RTM_NEWTCLASS, NLM_F_CREATE,
+				       argc-1, argv+1, buf, buflen);
 	if (matches(*argv, "delete") == 0)
-		return tc_class_modify(RTM_DELTCLASS, 0,  argc-1, argv+1);
+		return tc_class_modify(RTM_DELTCLASS, 0, argc-1, argv+1,
+				       buf, buflen);
 #if 0
 	if (matches(*argv, "get") == 0)
 		return tc_class_get(RTM_GETTCLASS, 0,  argc-1, argv+1);
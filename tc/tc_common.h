@@ -5,8 +5,8 @@
 
 extern struct rtnl_handle rth;
 
-int do_qdisc(int argc, char **argv);
-int do_class(int argc, char **argv);
+int do_qdisc(int argc, char **argv, void *buf, size_t buflen);
+int do_class(int argc, char **argv, void *buf, size_t buflen);
 int do_filter(int argc, char **argv, void *buf, size_t buflen);
 int do_chain(int argc, char **argv, void *buf, size_t buflen);
 int do_action(int argc, char **argv, void *buf, size_t buflen);
@@ -39,7 +39,7 @@ static int accept_tcmsg(struct rtnl_ctrl_data *ctrl,
 {
 	FILE *fp = (FILE *)arg;
 
-	if (timestamp)
+	if (timestamp && !is_json_context())
 		print_timestamp(fp);
 
 	if (n->nlmsg_type == RTM_NEWTFILTER ||
@@ -100,7 +100,9 @@ int do_tcmonitor(int argc, char **argv)
 			exit(-1);
 		}
 
+		new_json_obj(json);
 		ret = rtnl_from_file(fp, accept_tcmsg, stdout);
+		delete_json_obj();
 		fclose(fp);
 		return ret;
 	}
@@ -110,6 +112,9 @@ int do_tcmonitor(int argc, char **argv)
 
 	ll_init_map(&rth);
 
+	new_json_obj(json);
+	rth.idle = fflush_fp;
+
 	if (rtnl_listen(&rth, accept_tcmsg, (void *)stdout) < 0) {
 		rtnl_close(&rth);
 		exit(2);
@@ -42,8 +42,16 @@ static int usage(void)
 	return -1;
 }
 
-static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv)
+struct tc_qdisc_req {
+	struct nlmsghdr		n;
+	struct tcmsg		t;
+	char			buf[TCA_BUF_MAX];
+};
+
+static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv,
+			   void *buf, size_t buflen)
 {
+	struct tc_qdisc_req *req, qdisc_req;
 	struct qdisc_util *q = NULL;
 	struct tc_estimator est = {};
 	struct {
@@ -52,19 +60,25 @@ static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv)
 	} stab = {};
 	char  d[IFNAMSIZ] = {};
 	char  k[FILTER_NAMESZ] = {};
-	struct {
-		struct nlmsghdr	n;
-		struct tcmsg		t;
-		char			buf[TCA_BUF_MAX];
-	} req = {
-		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg)),
-		.n.nlmsg_flags = NLM_F_REQUEST | flags,
-		.n.nlmsg_type = cmd,
-		.t.tcm_family = AF_UNSPEC,
-	};
 	__u32 ingress_block = 0;
 	__u32 egress_block = 0;
 
+	if (buf) {
+		req = buf;
+		if (buflen < sizeof(struct tc_qdisc_req)) {
+			fprintf(stderr, "buffer is too small: %zu\n", buflen);
+			return -1;
+		}
+	} else {
+		memset(&qdisc_req, 0, sizeof(struct tc_qdisc_req));
+		req = &qdisc_req;
+	}
+
+	req->n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+	req->n.nlmsg_flags = NLM_F_REQUEST | flags;
+	req->n.nlmsg_type = cmd;
+	req->t.tcm_family = AF_UNSPEC;
+
 	while (argc > 0) {
 		if (strcmp(*argv, "dev") == 0) {
 			NEXT_ARG();
@@ -74,49 +88,49 @@ static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv)
 		} else if (strcmp(*argv, "handle") == 0) {
 			__u32 handle;
 
-			if (req.t.tcm_handle)
+			if (req->t.tcm_handle)
 				duparg("handle", *argv);
 			NEXT_ARG();
 			if (get_qdisc_handle(&handle, *argv))
 				invarg("invalid qdisc ID", *argv);
-			req.t.tcm_handle = handle;
+			req->t.tcm_handle = handle;
 		} else if (strcmp(*argv, "root") == 0) {
-			if (req.t.tcm_parent) {
+			if (req->t.tcm_parent) {
 				fprintf(stderr, "Error: \"root\" is duplicate parent ID\n");
 				return -1;
 			}
-			req.t.tcm_parent = TC_H_ROOT;
+			req->t.tcm_parent = TC_H_ROOT;
 		} else if (strcmp(*argv, "clsact") == 0) {
-			if (req.t.tcm_parent) {
+			if (req->t.tcm_parent) {
 				fprintf(stderr, "Error: \"clsact\" is a duplicate parent ID\n");
 				return -1;
 			}
-			req.t.tcm_parent = TC_H_CLSACT;
+			req->t.tcm_parent = TC_H_CLSACT;
 			strncpy(k, "clsact", sizeof(k) - 1);
 			q = get_qdisc_kind(k);
-			req.t.tcm_handle = TC_H_MAKE(TC_H_CLSACT, 0);
+			req->t.tcm_handle = TC_H_MAKE(TC_H_CLSACT, 0);
 			NEXT_ARG_FWD();
 			break;
 		} else if (strcmp(*argv, "ingress") == 0) {
-			if (req.t.tcm_parent) {
+			if (req->t.tcm_parent) {
 				fprintf(stderr, "Error: \"ingress\" is a duplicate parent ID\n");
 				return -1;
 			}
-			req.t.tcm_parent = TC_H_INGRESS;
+			req->t.tcm_parent = TC_H_INGRESS;
 			strncpy(k, "ingress", sizeof(k) - 1);
 			q = get_qdisc_kind(k);
-			req.t.tcm_handle = TC_H_MAKE(TC_H_INGRESS, 0);
+			req->t.tcm_handle = TC_H_MAKE(TC_H_INGRESS, 0);
 			NEXT_ARG_FWD();
 			break;
 		} else if (strcmp(*argv, "parent") == 0) {
 			__u32 handle;
 
 			NEXT_ARG();
-			if (req.t.tcm_parent)
+			if (req->t.tcm_parent)
 				duparg("parent", *argv);
 			if (get_tc_classid(&handle, *argv))
 				invarg("invalid parent ID", *argv);
-			req.t.tcm_parent = handle;
+			req->t.tcm_parent = handle;
 		} else if (matches(*argv, "estimator") == 0) {
 			if (parse_estimator(&argc, &argv, &est))
 				return -1;
@@ -145,20 +159,20 @@ static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv)
 	}
 
 	if (k[0])
-		addattr_l(&req.n, sizeof(req), TCA_KIND, k, strlen(k)+1);
+		addattr_l(&req->n, sizeof(*req), TCA_KIND, k, strlen(k)+1);
 	if (est.ewma_log)
-		addattr_l(&req.n, sizeof(req), TCA_RATE, &est, sizeof(est));
+		addattr_l(&req->n, sizeof(*req), TCA_RATE, &est, sizeof(est));
 
 	if (ingress_block)
-		addattr32(&req.n, sizeof(req),
+		addattr32(&req->n, sizeof(*req),
 			  TCA_INGRESS_BLOCK, ingress_block);
 	if (egress_block)
-		addattr32(&req.n, sizeof(req),
+		addattr32(&req->n, sizeof(*req),
 			  TCA_EGRESS_BLOCK, egress_block);
 
 	if (q) {
 		if (q->parse_qopt) {
-			if (q->parse_qopt(q, argc, argv, &req.n, d))
+			if (q->parse_qopt(q, argc, argv, &req->n, d))
 				return 1;
 		} else if (argc) {
 			fprintf(stderr, "qdisc '%s' does not support option parsing\n", k);
@@ -182,13 +196,13 @@ static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv)
 			return -1;
 		}
 
-		tail = addattr_nest(&req.n, sizeof(req), TCA_STAB);
-		addattr_l(&req.n, sizeof(req), TCA_STAB_BASE, &stab.szopts,
+		tail = addattr_nest(&req->n, sizeof(*req), TCA_STAB);
+		addattr_l(&req->n, sizeof(*req), TCA_STAB_BASE, &stab.szopts,
 			  sizeof(stab.szopts));
 		if (stab.data)
-			addattr_l(&req.n, sizeof(req), TCA_STAB_DATA, stab.data,
+			addattr_l(&req->n, sizeof(*req), TCA_STAB_DATA, stab.data,
 				  stab.szopts.tsize * sizeof(__u16));
-		addattr_nest_end(&req.n, tail);
+		addattr_nest_end(&req->n, tail);
 		if (stab.data)
 			free(stab.data);
 	}
@@ -201,10 +215,13 @@ static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv)
 		idx = ll_name_to_index(d);
 		if (!idx)
 			return -nodev(d);
-		req.t.tcm_ifindex = idx;
+		req->t.tcm_ifindex = idx;
 	}
 
-	if (rtnl_talk(&rth, &req.n, NULL) < 0)
+	if (buf)
+		return 0;
+
+	if (rtnl_talk(&rth, &req->n, NULL) < 0)
 		return 2;
 
 	return 0;
@@ -413,20 +430,25 @@ static int tc_qdisc_list(int argc, char **argv)
 	return 0;
 }
 
-int do_qdisc(int argc, char **argv)
+int do_qdisc(int argc, char **argv, void *buf, size_t buflen)
 {
 	if (argc < 1)
 		return tc_qdisc_list(0, NULL);
 	if (matches(*argv, "add") == 0)
-		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_EXCL|NLM_F_CREATE, argc-1, argv+1);
+		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_EXCL|NLM_F_CREATE,
+				       argc-1, argv+1, buf, buflen);
 	if (matches(*argv, "change") == 0)
-		return tc_qdisc_modify(RTM_NEWQDISC, 0, argc-1, argv+1);
+		return tc_qdisc_modify(RTM_NEWQDISC, 0, argc-1, argv+1,
+				       buf, buflen);
 	if (matches(*argv, "replace") == 0)
-		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_CREATE|NLM_F_REPLACE, argc-1, argv+1);
+		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_CREATE|NLM_F_REPLACE,
+				       argc-1, argv+1, buf, buflen);
 	if (matches(*argv, "link") == 0)
-		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_REPLACE, argc-1, argv+1);
+		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_REPLACE,
+				       argc-1, argv+1, buf, buflen);
 	if (matches(*argv, "delete") == 0)
-		return tc_qdisc_modify(RTM_DELQDISC, 0,  argc-1, argv+1);
+		return tc_qdisc_modify(RTM_DELQDISC, 0, argc-1, argv+1,
+				       buf, buflen);
 #if 0
 	if (matches(*argv, "get") == 0)
 		return tc_qdisc_get(RTM_GETQDISC, 0,  argc-1, argv+1);
@@ -0,0 +1,18 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+# 20000 links with three IPv4 addresses each, see tools/generate_nlmsg.c
+export IPADDR_DUMP_FILE="tests/ip/address/addr_bench.nl"
+
+ts_log "[Testing address listing from a saved dump]"
+
+START=$(date +%s%N)
+ts_ip "$0" "Show addresses of 20000 links" -o -4 address show
+END=$(date +%s%N)
+test_lines_count 60000
+ts_log "ip -o -4 address show: $(( (END - START) / 1000000 )) ms"
+
+ts_ip "$0" "Show addresses of one prefix" address show to 10.0.0.4/30
+test_on "inet 10.0.0.5/30 scope global veth1"
+test_lines_count 7
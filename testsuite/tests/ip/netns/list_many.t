@@ -0,0 +1,30 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+ts_log "[Testing netns list with many namespaces]"
+
+COUNT=200
+NS=testlist
+BATCHFILE=`mktemp`
+
+for i in $(seq 1 $COUNT); do
+	echo "netns add $NS$i" >> $BATCHFILE
+	echo "netns set $NS$i $((1000 + i))" >> $BATCHFILE
+done
+ts_ip "$0" "Add $COUNT netns with nsids" -b $BATCHFILE
+
+# startup cost: the nsids are all fetched before the first line is out
+START=$(date +%s%N)
+ts_ip "$0" "List $COUNT netns" netns list
+END=$(date +%s%N)
+ts_log "netns list of $COUNT namespaces took $(( (END - START) / 1000 ))us"
+test_on "^${NS}1 \(id: 1001\)$"
+test_on "^$NS$COUNT \(id: $((1000 + COUNT))\)$"
+
+> $BATCHFILE
+for i in $(seq 1 $COUNT); do
+	echo "netns del $NS$i" >> $BATCHFILE
+done
+ts_ip "$0" "Delete $COUNT netns" -b $BATCHFILE
+rm -f $BATCHFILE
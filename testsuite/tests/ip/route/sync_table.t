@@ -0,0 +1,49 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+ts_log "[Testing route table sync]"
+
+DEV="$(rand_dev)"
+ROUTES=$(mktemp)
+
+ts_ip "$0" "Add $DEV dummy interface" link add dev $DEV type dummy
+ts_ip "$0" "Set $DEV into UP state" link set up dev $DEV
+ts_ip "$0" "Add 1.1.1.1/24 addr on $DEV" addr add 1.1.1.1/24 dev $DEV
+
+ts_ip "$0" "Add 2.2.2.0/24 via 1.1.1.2" route add 2.2.2.0/24 via 1.1.1.2
+ts_ip "$0" "Add 3.3.3.0/24 via 1.1.1.2" route add 3.3.3.0/24 via 1.1.1.2
+ts_ip "$0" "Add 4.4.4.0/24 via 1.1.1.2" route add 4.4.4.0/24 via 1.1.1.2
+
+cat > $ROUTES <<EOR
+2.2.2.0/24 via 1.1.1.2
+3.3.3.0/24 via 1.1.1.3
+5.5.5.0/24 dev $DEV
+EOR
+
+ts_ip "$0" "Sync main table" -4 -s route sync $ROUTES
+test_on "1 added, 1 changed, 1 deleted, 1 unchanged"
+
+ts_ip "$0" "Show IPv4 routes via $DEV" -4 route show dev $DEV
+test_on "2.2.2.0/24 via 1.1.1.2"
+test_on "3.3.3.0/24 via 1.1.1.3"
+test_on_not "4.4.4.0/24"
+test_on "5.5.5.0/24"
+test_lines_count 4
+
+ts_ip "$0" "Sync main table again" -4 -s route sync $ROUTES
+test_on "0 added, 0 changed, 0 deleted, 3 unchanged"
+
+ts_ip "$0" "Add 2001:db8:5::/64 dev $DEV" -6 route add 2001:db8:5::/64 dev $DEV
+ts_ip "$0" "Add multipath 6.6.6.0/24" route add 6.6.6.0/24 \
+	nexthop via 1.1.1.2 weight 2 nexthop via 1.1.1.3
+echo "6.6.6.0/24 nexthop via 1.1.1.2 weight 2 nexthop via 1.1.1.3" >> $ROUTES
+
+ts_ip "$0" "Sync main table without -4" -s route sync $ROUTES
+test_on "0 added, 0 changed, 0 deleted, 4 unchanged"
+
+ts_ip "$0" "Show IPv6 routes via $DEV" -6 route show dev $DEV
+test_on "2001:db8:5::/64"
+
+rm -f $ROUTES
+ts_ip "$0" "Del $DEV dummy interface" link del dev $DEV
@@ -0,0 +1,23 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+# % ./misc/ss -Htna
+# LISTEN  0    128    0.0.0.0:22       0.0.0.0:*
+# ESTAB   0    0     10.0.0.1:22      10.0.0.1:36266
+# ESTAB   0    0     10.0.0.1:36266   10.0.0.1:22
+# ESTAB   0    0     10.0.0.1:22      10.0.0.2:50312
+export TCPDIAG_FILE="$(dirname $0)/ss1.dump"
+
+ts_log "[Testing --group-by]"
+
+ts_ss "$0" "Group by state" -Htna --group-by state
+test_on "ESTAB  3 0   0"
+test_on "LISTEN 1 0 128"
+
+ts_ss "$0" "Group by state and lport" -Htna --group-by state,lport
+test_on "ESTAB  22    2 0   0"
+test_on "ESTAB  36266 1 0   0"
+
+ts_ss "$0" "Group by dst/24" -Htna --group-by dst/24 dst 10.0.0.0/8
+test_on "10.0.0.0/24 3 0 0"
@@ -0,0 +1,49 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+ts_log "[Testing ss -K with more sockets than SOCK_DESTROY requests in flight]"
+
+# more than the 256 requests ss keeps in flight
+COUNT=400
+PORT=5555
+READY="$(mktemp)"
+
+if ! command -v python3 >/dev/null 2>&1; then
+	ts_log "ss -K: python3 is needed to open the sockets, skipping"
+	ts_skip
+fi
+
+$IP link set lo up
+python3 - "$COUNT" "$PORT" "$READY" <<'EOF' &
+import socket, sys, time
+count, port, ready = int(sys.argv[1]), int(sys.argv[2]), sys.argv[3]
+l = socket.socket()
+l.bind(("127.0.0.1", port))
+l.listen(count)
+c = [socket.create_connection(("127.0.0.1", port)) for i in range(count)]
+a = [l.accept()[0] for i in range(count)]
+open(ready, "w").write("ready\n")
+time.sleep(10)
+EOF
+PID=$!
+
+i=0
+while [ ! -s "$READY" ] && [ $i -lt 50 ]; do
+	sleep 0.1
+	i=$((i + 1))
+done
+
+"$SS" -HK -tn dport = :$PORT 2> $STD_ERR > $STD_OUT
+if ! grep -q "^Killed $COUNT sockets" $STD_ERR; then
+	ts_err "$0: not all $COUNT sockets were killed"
+	ts_err_cat $STD_ERR
+elif [ "$(sort -u $STD_OUT | wc -l)" -ne $COUNT ]; then
+	ts_err "$0: killed sockets are not shown once each"
+	ts_err_cat $STD_OUT
+else
+	echo "$0: $COUNT sockets killed and shown once each"
+fi
+
+kill $PID 2>/dev/null
+rm -f "$READY"
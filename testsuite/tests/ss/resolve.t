@@ -0,0 +1,20 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+# Names come from a hosts file instead of the system resolver
+export TCPDIAG_FILE="$(dirname $0)/ss1.dump"
+export RESOLVE_HOSTS_FILE="$(dirname $0)/ss1.hosts"
+
+ts_log "[Testing ss -r]"
+
+ts_ss "$0" "Resolve addresses" -Htnr
+test_on "LISTEN +0 +128 +0.0.0.0:22 +0.0.0.0:\*"
+test_on "ESTAB +0 +0 +host-a:22 +host-a:36266"
+test_on "ESTAB +0 +0 +host-a:36266 +host-a:22"
+test_on "ESTAB +0 +0 +host-a:22 +host-b.example:50312"
+test_lines_count 4
+
+ts_ss "$0" "Resolve addresses in a filter" -Htnr dst 10.0.0.2
+test_on "ESTAB +0 +0 +host-a:22 +host-b.example:50312"
+test_lines_count 1
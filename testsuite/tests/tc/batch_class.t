@@ -0,0 +1,37 @@
+#!/bin/sh
+. lib/generic.sh
+
+DEV="$(rand_dev)"
+ts_ip "$0" "Add $DEV dummy interface" link add dev $DEV type dummy
+ts_ip "$0" "Enable $DEV" link set $DEV up
+
+TMP="$(mktemp)"
+cat > "$TMP" <<EOT
+qdisc add dev $DEV root handle 1: htb
+# classes and their leaf qdiscs go out in one batch
+class add dev $DEV parent 1: classid 1:1 htb rate 10mbit
+class add dev $DEV parent 1:1 classid 1:10 \\
+	htb rate 5mbit
+qdisc add dev $DEV parent 1:10 handle 10: pfifo
+class add dev $DEV parent 1:1 classid 1:10 htb rate 5mbit
+class add dev $DEV parent 1:1 classid 1:20 htb rate 5mbit
+qdisc add dev $DEV parent 1:20 handle 20: pfifo
+EOT
+
+"$TC" -force -b "$TMP" 2> $STD_ERR > $STD_OUT
+if [ $? -eq 0 ]; then
+	ts_err "$0: batch passed when it should have failed"
+elif ! grep -q "Command failed $TMP:7\$" $STD_ERR; then
+	ts_err "$0: duplicate class not reported on line 7"
+	ts_err_cat $STD_ERR
+else
+	echo "$0: batch failed on line 7, as expected"
+fi
+
+ts_tc "$0" "Show classes" class show dev $DEV
+test_on "class htb 1:20 parent 1:1 leaf 20:"
+ts_tc "$0" "Show qdiscs" qdisc show dev $DEV
+test_on "qdisc pfifo 20: parent 1:20"
+
+rm "$TMP"
+ts_ip "$0" "Del $DEV dummy interface" link del dev $DEV
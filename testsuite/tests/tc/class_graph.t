@@ -0,0 +1,36 @@
+#!/bin/sh
+. lib/generic.sh
+
+DEV="$(rand_dev)"
+ts_ip "$0" "Add $DEV dummy interface" link add dev $DEV type dummy
+ts_ip "$0" "Enable $DEV" link set $DEV up
+
+# 1: -+- 1:1 -+- 1:10
+#     |       `- 1:20 -+- 1:21
+#     |                `- 1:22
+#     `- 1:2
+ts_tc "$0" "Add htb root" qdisc add dev $DEV root handle 1: htb
+ts_tc "$0" "Add class 1:1" class add dev $DEV parent 1: classid 1:1 \
+	htb rate 10mbit
+ts_tc "$0" "Add class 1:10" class add dev $DEV parent 1:1 classid 1:10 \
+	htb rate 5mbit
+ts_tc "$0" "Add class 1:20" class add dev $DEV parent 1:1 classid 1:20 \
+	htb rate 3mbit
+ts_tc "$0" "Add class 1:21" class add dev $DEV parent 1:20 classid 1:21 \
+	htb rate 1mbit
+ts_tc "$0" "Add class 1:22" class add dev $DEV parent 1:20 classid 1:22 \
+	htb rate 1mbit
+ts_tc "$0" "Add class 1:2" class add dev $DEV parent 1: classid 1:2 \
+	htb rate 1mbit
+
+ts_tc "$0" "Show class graph" -g -s class show dev $DEV
+test_on "^\+---\(1:1\) htb rate 10Mbit"
+test_on "^\+---\(1:2\) htb"
+test_on "^     \+---\(1:10\) htb"
+test_on "^     \+---\(1:20\) htb rate 3Mbit"
+test_on "^          \+---\(1:21\) htb"
+test_on "^          \+---\(1:22\) htb"
+test_on "^     \|    subtree rate 0bit 0pps leaves 3$"
+test_on "^          \|     subtree rate 0bit 0pps leaves 2$"
+
+ts_ip "$0" "Del $DEV dummy interface" link del dev $DEV
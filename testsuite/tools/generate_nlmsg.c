@@ -15,6 +15,7 @@
 #include <linux/if.h>
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 
 int fill_vf_rate_test(void *buf, size_t buflen)
 {
@@ -91,6 +92,109 @@ int fill_vf_rate_test(void *buf, size_t buflen)
 	return h->nlmsg_len;
 }
 
+#define INFINITY_LIFE_TIME	0xFFFFFFFFU
+
+#define BENCH_LINKS		20000
+#define BENCH_ADDRS_PER_LINK	3
+
+static int fill_bench_link(void *buf, size_t buflen, int index)
+{
+	char mac[6] = { 0x02, 0x00, 0x00, 0x00, index >> 8, index & 0xff };
+	char bcmac[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	struct nlmsghdr *h = buf;
+	struct ifinfomsg *ifi;
+	char name[IFNAMSIZ];
+
+	memset(buf, 0, buflen);
+	h->nlmsg_type = RTM_NEWLINK;
+	h->nlmsg_len = NLMSG_LENGTH(sizeof(*ifi));
+
+	ifi = NLMSG_DATA(h);
+	ifi->ifi_type = ARPHRD_ETHER;
+	ifi->ifi_index = index;
+	ifi->ifi_flags = IFF_RUNNING | IFF_BROADCAST |
+			 IFF_MULTICAST | IFF_UP | IFF_LOWER_UP;
+
+	snprintf(name, sizeof(name), "veth%d", index);
+	ATTR_STRZ(IFLA_IFNAME, name);
+	ATTR_32(IFLA_TXQLEN, 1000);
+	ATTR_8(IFLA_OPERSTATE, 6);
+	ATTR_32(IFLA_MTU, 1500);
+	ATTR_32(IFLA_GROUP, 0);
+	ATTR_STRZ(IFLA_QDISC, "noqueue");
+	ATTR_L(IFLA_ADDRESS, mac, sizeof(mac));
+	ATTR_L(IFLA_BROADCAST, bcmac, sizeof(bcmac));
+
+	return NLMSG_ALIGN(h->nlmsg_len);
+}
+
+static int fill_bench_addr(void *buf, size_t buflen, int index, int n)
+{
+	struct ifa_cacheinfo ci = {
+		.ifa_prefered = INFINITY_LIFE_TIME,
+		.ifa_valid = INFINITY_LIFE_TIME,
+	};
+	struct nlmsghdr *h = buf;
+	struct ifaddrmsg *ifa;
+	__u32 addr = htonl(0x0a000000 | (index << 2) | n);
+	char name[IFNAMSIZ];
+
+	memset(buf, 0, buflen);
+	h->nlmsg_type = RTM_NEWADDR;
+	h->nlmsg_len = NLMSG_LENGTH(sizeof(*ifa));
+
+	ifa = NLMSG_DATA(h);
+	ifa->ifa_family = AF_INET;
+	ifa->ifa_prefixlen = 30;
+	ifa->ifa_flags = IFA_F_PERMANENT;
+	ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+	ifa->ifa_index = index;
+
+	snprintf(name, sizeof(name), "veth%d", index);
+	ATTR_L(IFA_ADDRESS, &addr, sizeof(addr));
+	ATTR_L(IFA_LOCAL, &addr, sizeof(addr));
+	ATTR_STRZ(IFA_LABEL, name);
+	ATTR_L(IFA_CACHEINFO, &ci, sizeof(ci));
+
+	return NLMSG_ALIGN(h->nlmsg_len);
+}
+
+/* Link and address dump of a host with many small interfaces, links
+ * first and addresses after them, like the kernel dumps them.
+ */
+static int write_addr_bench(const char *name)
+{
+	char buf[1024];
+	int i, n, len;
+	FILE *fp;
+
+	fp = fopen(name, "w");
+	if (!fp) {
+		perror("fopen()");
+		return -1;
+	}
+
+	for (i = 1; i <= BENCH_LINKS; i++) {
+		len = fill_bench_link(buf, sizeof(buf), i);
+		if (len < 0 || fwrite(buf, len, 1, fp) != 1)
+			goto err;
+	}
+	for (i = 1; i <= BENCH_LINKS; i++) {
+		for (n = 0; n < BENCH_ADDRS_PER_LINK; n++) {
+			len = fill_bench_addr(buf, sizeof(buf), i, n);
+			if (len < 0 || fwrite(buf, len, 1, fp) != 1)
+				goto err;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+err:
+	fprintf(stderr, "failed to write %s\n", name);
+	fclose(fp);
+	return -1;
+}
+
 int main(void)
 {
 	char buf[16384] = { 0 };
@@ -112,5 +216,9 @@ int main(void)
 		return 1;
 	}
 	fclose(fp);
+
+	if (write_addr_bench("tests/ip/address/addr_bench.nl") < 0)
+		return 1;
+
 	return 0;
 }